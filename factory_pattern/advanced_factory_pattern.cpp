@@ -1,339 +1,251 @@
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <string>
 #include <vector>
-#include <memory>
-#include <spdlog/spdlog.h>
+
+#include "daq_app.h"
+#include "daq_backend_registry.h"
+#include "daq_tick_driver.h"
 
 /*
- * In building an application, we want the application to be providing all of the front-end level interface
- * In the case of a Data Acquisition application, we want to be able to retrieve data using some sort of a backend
- * that should be abstracted
- *
- * In the case of DAQ, you can have different backends that is specific for each protocol since every one of them have different
- * ways of being setup and initialized (e.g. UDP requires the socket to be binded if server or connected if client)
- *
- * We can imagine that for each of this mode, there will always be specific abstract interface that works for all of them. For instance:
- *   * setup()      - Mode specific implementation for setting up any protocols
- *   * init()       - Initialize each modes with their channels (setup UART driver etc.)
- *   * update()     - Handle different messages streaming in (event driven or callbacks)
- *   * shutdown()   - What happens if the user closes this mode? How do we clear the data? Should we save unsaved data if we are recording the data in real time?
- *
- * With that, each of these functions, will need to be purely virtual, defined as follow:
- *   virtual <return type> <function name> = 0;
- *
- * Do not get confused between using only virtual and virtual = 0. The latter means pure virtual which means that each function defined with this
- * needs to be overriden! As for the former, the user can decide to override them or use the default implementation which can be implemented in the parent class.
- * If however, you wish to tell the developer that they should not discard the 
+ * The DAQ application itself (DAQ_App and every backend) lives in daq_app.h / daq_app.cpp, so that other executables such as the
+ * benchmark can build on it. This file only shows how an application would drive it.
  */
 
-// Uncomment this to see how each backend behaves if we use the default implementation from the backend base class
-#define UDP_OVERRIDE_BACKEND
-#define MAVLINK_OVERRIDE_BACKEND
-
 /*
-In this example, I have created it in such a way that this definition allows you to show the "full" potential of using
-the factory pattern.
-
-In the case of multiple backend, there will be a backend manager, where this will store all of the pointer to our
-respective backend protocols. In this example, I want to have backends for Mavlink and UDP. So, the backend manager will
-respectively initialize both the protocols accordingly, and in the update() function of the application, it will use the abstract
-interface to call the update() function of each backend.
-
-This allows us to be able to add more protocol backends without worrying of breaking the application for as long as the developer
-respects the virtual interface provided (e.g. init(), update(), shutdown()).
-
-If you wish to simplify the example with only a single backend to get a better initial understanding of how it works, uncomment the
-ALLOW_MULTIPLE_BACKENDS definition!
+When running in DAQ_Mode::REAL_TIME, everything the backends receive is recorded into this capture file (see daq_recorder.h).
+Run the example again with the file as argument to replay the session in DAQ_Mode::DATA_PLAYBACK.
+Comment this out to disable the recording.
 */
-#define ALLOW_MULTIPLE_BACKENDS
+#define RECORDING_FILE "daq_recording.cap"
 
 /*
-NOTE:
-Please note that these examples do not try to handle errors if we fail to initialize the protocol. I try to implement
-everything as "easy" as possible so that you may take this and use as sort of a skeleton to build your application further.
+Every backend counts its messages, bytes, drops, parse errors and update() latencies (see daq_metrics.h). With this defined, the
+application logs them at this period. Comment this out to disable the dump, the counters are still there through metrics_snapshot().
 */
+#define METRICS_DUMP_PERIOD_MS 1000
 
-// Forward declaration
-class DAQ_Backend;
-class DAQ_Mavlink;
-class DAQ_UDP;
-
-enum class DAQ_Protocol {
-    INVALID = -1,
-    MAVLINK = 0,
-    UDP = 1,
-};
-
-enum class DAQ_Mode {
-    INVALID=-1,
-    REAL_TIME=0,
-    DATA_PLAYBACK = 1,
-    SIMULATION = 2,
-};
+/*
+In DAQ_Mode::REAL_TIME, the application is driven by the event loop by default (USE_EVENT_LOOP, or the plain update() loop without
+it). Passing --fixed-rate <period in ms> instead acquires exactly every period for ACQUISITION_DURATION_MS, driven by DAQ_Tick_Driver
+(absolute deadlines, so no drift). TICK_SPIN_US is how long before each deadline the driver stops sleeping and busy-waits, which
+trades a core for lower jitter. The jitter and overrun statistics are logged at the end.
+For the best results, run it on an isolated core (TICK_CORE) with a real time priority (TICK_REALTIME_PRIORITY).
+*/
+#define ACQUISITION_DURATION_MS 1000
+#define TICK_SPIN_US 50
+// #define TICK_CORE 3
+// #define TICK_REALTIME_PRIORITY 80
 
-class DAQ_App {
+int main(int argc, char **argv) {
 
-public:
+    /*
+     * The application implementation should be as simple as possible where the app should
+     * store its current state and for each different states (e.g. init, update), it should have its own
+     * respective function. This will help you in tracing at what point your application is, and it also helps
+     * in "visualizing" the flow of your application.
+     */
+    DAQ_App daq_app;
 
-    // DAQ state implementation
-    DAQ_App() = default;
+    // Startup configuration, before the mode arguments:
+    //   --plugin <shared library>   loads more backends into the registry (e.g. libdaq_counter_plugin.so), can be repeated
+    //   --backends <name,name,...>  backends to run in DAQ_Mode::REAL_TIME, by registered name. Default is udp,mavlink
+    //   --fixed-rate <period ms>    acquire at a fixed rate with DAQ_Tick_Driver rather than with the event loop
+    std::vector<std::string> backend_names {"udp", "mavlink"};
+    uint32_t fixed_rate_ms = 0;
+    int arg = 1;
+    while (arg + 1 < argc) {
+        if (std::strcmp(argv[arg], "--plugin") == 0) {
+            if (!DAQ_Backend_Registry::instance().load_plugin(argv[arg + 1])) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[arg], "--backends") == 0) {
+            backend_names.clear();
+            std::string list = argv[arg + 1];
+            size_t start = 0;
+            while (start <= list.size()) {
+                const size_t end = std::min(list.find(',', start), list.size());
+                backend_names.push_back(list.substr(start, end - start));
+                start = end + 1;
+            }
+        } else if (std::strcmp(argv[arg], "--fixed-rate") == 0) {
+            fixed_rate_ms = static_cast<uint32_t>(std::max(std::atoi(argv[arg + 1]), 0));
+        } else {
+            break;
+        }
+        arg += 2;
+    }
 
-#ifdef ALLOW_MULTIPLE_BACKENDS
-    bool init(const std::vector<DAQ_Protocol> protocols);
-#else
-    bool init(const DAQ_Protocol protocol);
+    // --simulate switches the application to DAQ_Mode::SIMULATION for a few seconds, with one UDP and one (slightly corrupted)
+    // MAVLink traffic generator
+    if (arg < argc && std::strcmp(argv[arg], "--simulate") == 0) {
+        DAQ_Traffic_Config udp_traffic;
+        udp_traffic.messages_per_second = 10000.0;
+        udp_traffic.burst_size = 10;
+
+        DAQ_Traffic_Config mavlink_traffic;
+        mavlink_traffic.type = DAQ_Traffic_Type::MAVLINK_ATTITUDE;
+        mavlink_traffic.messages_per_second = 5000.0;
+        mavlink_traffic.corruption_ratio = 0.01;
+        mavlink_traffic.seed = 2;
+
+        daq_app.init_simulation({udp_traffic, mavlink_traffic});
+        // Round robin batches of 256 messages, and no tick longer than 1 ms however hard the generators push
+        daq_app.set_batching(256, std::chrono::milliseconds(1));
+        // What a dashboard would ask for: the past second and the past 10 seconds
+        daq_app.set_aggregation_windows({std::chrono::seconds(1), std::chrono::seconds(10)});
+        // Roll, pitch and yaw of the MAVLink simulation, column by column
+        DAQ_Sample_Store *attitude_store = daq_app.attach_sample_store(1, 3);
+#ifdef METRICS_DUMP_PERIOD_MS
+        daq_app.start_metrics_dump(std::chrono::milliseconds(METRICS_DUMP_PERIOD_MS));
 #endif
 
-    void update();
-    void shutdown();
-
-    bool is_running() { return _is_running; };
+        size_t total_samples = 0;
+        const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (std::chrono::steady_clock::now() < end) {
+            daq_app.wait_for_events(100);
+            total_samples += daq_app.get_latest_data().size();
+        }
+        spdlog::info("Simulation produced {} samples", total_samples);
+        for (size_t window = 0; window < 2; window++) {
+            const DAQ_Aggregate aggregate = daq_app.aggregate(window);
+            spdlog::info("Window {}: {} samples, min {:.3f} max {:.3f} mean {:.3f} last {:.3f}", window, aggregate.count,
+                         aggregate.min, aggregate.max, aggregate.mean(), aggregate.last);
+        }
+        const size_t rows = attitude_store->rows();
+        for (size_t channel = 0; channel < attitude_store->channels(); channel++) {
+            const DAQ_Aggregate aggregate = attitude_store->aggregate(channel, 0, rows);
+            spdlog::info("Attitude channel {}: {} rows, min {:.3f} max {:.3f} mean {:.3f}", channel, aggregate.count, aggregate.min,
+                         aggregate.max, aggregate.mean());
+        }
 
-    void set_running_flag(const bool flag) {
-        _is_running = flag;
+        daq_app.shutdown();
+        return 0;
     }
 
-    // API
-    const std::vector<float> &get_latest_data() const {};
-    uint32_t get_sample_rate_ms() {};
-
-    std::unique_ptr<DAQ_Backend> _create_backend(DAQ_Protocol protocol);
+    // Passing a capture file switches the application to DAQ_Mode::DATA_PLAYBACK:
+    //   advanced_factory_pattern <capture file> [speed, 1 = real time, 0 = as fast as possible]
+    if (arg < argc) {
+        const double speed = arg + 1 < argc ? std::atof(argv[arg + 1]) : 1.0;
+        if (!daq_app.init_playback(argv[arg], speed)) {
+            return 1;
+        }
 
-#ifdef ALLOW_MULTIPLE_BACKENDS
-    std::vector<std::unique_ptr<DAQ_Backend>> _daq_backend_manager;
+        while (daq_app.is_running()) {
+#ifdef USE_EVENT_LOOP
+            daq_app.wait_for_events(100);
 #else
-    std::unique_ptr<DAQ_Backend> _daq_backend;
-#endif // ALLOW_MULTIPLE_BACKENDS
-    
-
-private:
-
-    // Variable that stores the backend pointer
-    DAQ_Mode _current_daq_mode;
-    bool _is_running = false;
-
-};
-
-class DAQ_Backend {
-
-// friend is important to be able to access protected members of the backend base class
-friend class DAQ_UDP;
-friend class DAQ_Mavlink;
-
-public:
-    DAQ_Backend() = default;
-    ~DAQ_Backend() = default;
-
-    // Abstract function that each function should have in their backend implementation
-    virtual void setup() = 0;
-    virtual bool init() {
-        spdlog::info("Using default init() implementation for {}", protocol_type());
-    };
-    virtual void update() {
-        spdlog::info("Backend for {} has not been implemented. Using the default update() function.", protocol_type());
-        ++_backend_counter;
-        spdlog::info("Backend counter for {}: {}", protocol_type(), _backend_counter);
-    };
-
-    virtual void shutdown() {
-        spdlog::info("Using default shutdown() implementation for {}", protocol_type());
-    };
-
-    virtual const char *protocol_type() const = 0;
-
-protected:
-    size_t _backend_counter;
-};
-
-class DAQ_UDP: public DAQ_Backend {
-
-public:
-    DAQ_UDP() = default;
-    ~DAQ_UDP() = default;
-
-    // Overriding the virtual function from parent class
-    void setup() override {};
-
-
-#ifdef UDP_OVERRIDE_BACKEND
-    bool init() override {
-        spdlog::info("{} init() function. Initialize protocol specific socket/implementation.", protocol_type());
-    };
-    void update() override {
-        spdlog::info("{} update() function. Process data here.", protocol_type());
-    };
-    void shutdown() override {
-        spdlog::info("{} shutdown() function. Implement protocol specific cleanup here.", protocol_type());
-    };
-#endif
-
-    const char *protocol_type() const override { return "UDP"; }
-
-    // Protocol specific functions or variables
-    // Please read my notes on protocol specific functions in DAQ_Mavlink
-    void parse_udp_packets();
-    void receive_udp_packets();
-
-};
-
-class DAQ_Mavlink: public DAQ_Backend {
-
-public:
-    DAQ_Mavlink() = default;
-    ~DAQ_Mavlink() = default;
-
-    // Overriding the virtual function from parent class
-    void setup() override {};
-
-#ifdef MAVLINK_OVERRIDE_BACKEND
-    bool init() override {
-        spdlog::info("{} init() function. Initialize protocol specific socket/implementation.", protocol_type());
-    }
-    void update() override {
-        spdlog::info("{} update() function. Process data here.", protocol_type());
-    };
-    void shutdown() override {
-        spdlog::info("{} shutdown() function. Implement protocol specific cleanup here.", protocol_type());
-    };
+            daq_app.update();
 #endif
+            spdlog::info("Replayed {} samples this tick", daq_app.get_latest_data().size());
+            daq_app.set_running_flag(!daq_app.is_playback_finished());
+        }
 
-    const char *protocol_type() const override { return "Mavlink"; }
-
-    /* 
-     * Protocol specific function that may be important for this specific protocol. This should not be called on the
-     * application level as the application backend does not "know" about the existence of these functions.
-     * These functions should be called with the object of this specific class. For example:
-     * ================================================== 
-     * DAQ_Mavlink daq_mavlink;
-     * ...
-     * ...
-     * daq_mavlink.send_mavlink_packets();
-     * ================================================== 
-     *
-     * This is what you can call public function (aka developer API), if they are using your library. If you wish to hide some
-     * internal function that should only be called within the class, then put it under private!
-     * 
-     * Also, depending on certain protocols (e.g. UART), you may want to consider using singleton.
-     */
-    void send_heartbeat() {};
-    void listen_to_heartbeat() {};
-    void send_mavlink_packets() {};
-
-};
-
-std::unique_ptr<DAQ_Backend> DAQ_App::_create_backend(DAQ_Protocol protocol) {
-    switch(protocol) {
-        case DAQ_Protocol::MAVLINK:
-            return std::make_unique<DAQ_Mavlink>();
-        case DAQ_Protocol::UDP:
-            return std::make_unique<DAQ_UDP>();
-        default:
-            spdlog::info("Protocol provided either does not exist or has not been implemented");
-            return nullptr;
+        daq_app.shutdown();
+        return 0;
     }
-}
 
 #ifdef ALLOW_MULTIPLE_BACKENDS
-bool DAQ_App::init(const std::vector<DAQ_Protocol> protocols) {
-
-    for (size_t i = 0; i < protocols.size(); i++) {
-        std::unique_ptr<DAQ_Backend> backend_ptr;
-        backend_ptr = _create_backend(protocols[i]);
-
-        if (backend_ptr == nullptr) {
-            spdlog::warn("Fails to create backend for this protocol");
+    std::vector<DAQ_Protocol> protocols_to_use;
+    for (const std::string &name : backend_names) {
+        const DAQ_Protocol protocol = DAQ_Backend_Registry::instance().protocol(name);
+        if (protocol == DAQ_Protocol::INVALID) {
+            spdlog::warn("No backend named {}", name);
             continue;
-        } else {
-            backend_ptr->init();
         }
-
-        _daq_backend_manager.push_back(std::move(backend_ptr));
-    }
-
-    _is_running = true;
-
-    return true;
-}
-#else
-bool DAQ_App::init(const DAQ_Protocol protocol) {
-
-    _daq_backend = _create_backend(protocol);
-
-    if (_daq_backend == nullptr) {
-        spdlog::info("Fails to initialize the backend. The protocol provided is invalid");
-        return false;
-    }
-
-    spdlog::info("DAQ initialized for the following protocol: {}", _daq_backend->protocol_type());
-
-    if (_daq_backend->init()) {
-        spdlog::info("{} protocol has been initialized", _daq_backend->protocol_type());
+        protocols_to_use.push_back(protocol);
     }
-    
-    _is_running = true;
-
-    return true;
-    // In the init fuction for the application, we need to setup the necessary backend
-}
-#endif // ALLOW_MULTIPLE_BACKENDS
-
-void DAQ_App::update() {
 
-#ifdef ALLOW_MULTIPLE_BACKENDS
-    for (size_t i = 0; i < _daq_backend_manager.size(); i++) {
-        _daq_backend_manager[i]->update();
+    if (!daq_app.init(protocols_to_use)) {
+        spdlog::error("DAQ fails to initialize any of the backends. Force closing the application.");
+        return 0;
     }
 #else
-    _daq_backend->update();
+    DAQ_Protocol protocol_type = DAQ_Backend_Registry::instance().protocol(backend_names.front());
+    if (!daq_app.init(protocol_type)) {
+        spdlog::error("DAQ fails to initialize due to invalid protocol. Force closing the application.");
+        return 0;
+    };
 #endif
 
-}
-
-void DAQ_App::shutdown() {
-
-#ifdef ALLOW_MULTIPLE_BACKENDS
-    for (size_t i = 0; i < _daq_backend_manager.size(); i++) {
-        _daq_backend_manager[i]->shutdown();
-    }
-#else
-    _daq_backend->shutdown();
+#ifdef RECORDING_FILE
+    daq_app.start_recording(RECORDING_FILE);
 #endif
 
-}
-
-int main() {
+#ifdef METRICS_DUMP_PERIOD_MS
+    daq_app.start_metrics_dump(std::chrono::milliseconds(METRICS_DUMP_PERIOD_MS));
+#endif
 
     /*
-     * The application implementation should be as simple as possible where the app should
-     * store its current state and for each different states (e.g. init, update), it should have its own
-     * respective function. This will help you in tracing at what point your application is, and it also helps
-     * in "visualizing" the flow of your application.
+     * Small loopback sender so the UDP backend has something to receive. In a real setup this would be the sensor
+     * streaming to DAQ_UDP::DEFAULT_PORT.
      */
-    DAQ_App daq_app;
+    DAQ_UDP_Socket loopback_sender;
+    loopback_sender.open("127.0.0.1", 0);
+    const float fake_samples[] = {1.0f, 2.0f, 3.0f, 4.0f};
+
+    // Same idea for the MAVLink backend, pretend to be an autopilot (system 1) sending a heartbeat and its attitude
+    std::array<uint8_t, 2 * MAVLINK_MAX_FRAME_LEN> fake_mavlink;
+    const uint8_t heartbeat_payload[9] = {0, 0, 0, 0, 2, 3, 81, 4, 3};
+    const float attitude[7] = {0.0f, 0.1f, -0.2f, 1.57f, 0.0f, 0.0f, 0.0f};
+    size_t fake_mavlink_length = mavlink_pack_frame(fake_mavlink, 0, 1, 1, MAVLINK_MSG_ID_HEARTBEAT, heartbeat_payload);
+    fake_mavlink_length += mavlink_pack_frame(std::span(fake_mavlink).subspan(fake_mavlink_length), 1, 1, 1, MAVLINK_MSG_ID_ATTITUDE,
+                                              std::span(reinterpret_cast<const uint8_t *>(attitude), sizeof(attitude)));
+
+    auto send_fake_data = [&] {
+        loopback_sender.send_to("127.0.0.1", DAQ_UDP::DEFAULT_PORT,
+                                std::span(reinterpret_cast<const uint8_t *>(fake_samples), sizeof(fake_samples)));
+        loopback_sender.send_to("127.0.0.1", DAQ_Mavlink::DEFAULT_PORT,
+                                std::span<const uint8_t>(fake_mavlink.data(), fake_mavlink_length));
+    };
 
-#ifdef ALLOW_MULTIPLE_BACKENDS
-    std::vector<DAQ_Protocol> protocols_to_use {DAQ_Protocol::UDP, DAQ_Protocol::MAVLINK};
+    if (fixed_rate_ms > 0) {
+        daq_app.set_sample_rate_ms(fixed_rate_ms);
 
-    if (!daq_app.init(protocols_to_use)) {
-        spdlog::error("DAQ fails to initialize due to invalid protocol. Force closing the application.");
-        return 0;
-    }
-#else
-    DAQ_Protocol protocol_type = DAQ_Protocol::UDP;
-    if (!daq_app.init(protocol_type)) {
-        spdlog::error("DAQ fails to initialize due to invalid protocol. Force closing the application.");
-        return 0;
-    };
+#ifdef TICK_CORE
+        DAQ_Tick_Driver::pin_current_thread(TICK_CORE);
 #endif
+#ifdef TICK_REALTIME_PRIORITY
+        DAQ_Tick_Driver::set_realtime_priority(TICK_REALTIME_PRIORITY);
+#endif
+
+        DAQ_Tick_Driver tick_driver(std::chrono::milliseconds(daq_app.get_sample_rate_ms()),
+                                    std::chrono::microseconds(TICK_SPIN_US));
+        const size_t ticks = ACQUISITION_DURATION_MS / daq_app.get_sample_rate_ms();
 
-    if (daq_app.is_running()) {
+        for (size_t i = 0; i < ticks && daq_app.is_running(); i++) {
+            send_fake_data();
+            const uint64_t skipped = tick_driver.wait_next_tick();
+            if (skipped > 0) {
+                spdlog::warn("Acquisition overran, {} ticks skipped", skipped);
+            }
+            daq_app.update();
+            spdlog::info("Received {} samples this tick", daq_app.get_latest_data().size());
+        }
+        tick_driver.log_statistics();
+        daq_app.set_running_flag(false);
+    } else if (daq_app.is_running()) {
         for (size_t i = 0; i < 5; i++) {
+            send_fake_data();
+#ifdef USE_EVENT_LOOP
+            daq_app.wait_for_events(100);
+#else
             daq_app.update();
+#endif
+            spdlog::info("Received {} samples this tick", daq_app.get_latest_data().size());
         }
         daq_app.set_running_flag(false);
     }
 
+    // shutdown() drains what was still in flight into the rings, pick it up one last time
     daq_app.shutdown();
+    spdlog::info("Received {} in-flight samples during shutdown", daq_app.get_latest_data().size());
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * Incremental aggregation of the samples returned by DAQ_App::get_latest_data().
+ *
+ * Dashboards rarely want every raw sample, they want "min/max/mean/last over the past second, 10 seconds, minute". Rescanning the raw
+ * samples for every query costs as much as the window is long. Instead, the aggregates are maintained as the samples arrive:
+ *
+ *   block of samples --daq_reduce() (SIMD)--> one DAQ_Aggregate --merge()--> current sub-bucket of every window
+ *
+ * Every window is a ring of SUB_BUCKETS sub-buckets, each covering window / SUB_BUCKETS. A sub-bucket is identified by its epoch
+ * (time / width), so a sub-bucket from a previous lap of the ring is recognised as stale and reset instead of having to be cleared
+ * on a timer. A query merges the SUB_BUCKETS sub-buckets still inside the window, which is constant work whatever the sample rate.
+ * The price is granularity: the window slides by whole sub-buckets, so a "1 s" view covers between 0.9 s and 1 s of samples.
+ *
+ * min and max can not be subtracted back out when a sample leaves the window, which is why the ring of sub-buckets is needed rather
+ * than a single running sum.
+ */
+
+struct DAQ_Aggregate {
+    uint64_t count = 0;
+    float min = std::numeric_limits<float>::infinity();
+    float max = -std::numeric_limits<float>::infinity();
+    float last = 0.0f;
+    // Summed in double, a minute of samples in float would lose the small ones
+    double sum = 0.0;
+
+    double mean() const { return count > 0 ? sum / static_cast<double>(count) : 0.0; }
+
+    // other has to be the more recent of the two, it provides last
+    void merge(const DAQ_Aggregate &other) {
+        if (other.count == 0) {
+            return;
+        }
+        count += other.count;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        sum += other.sum;
+        last = other.last;
+    }
+};
+
+// Reference implementation, one sample at a time
+inline DAQ_Aggregate daq_reduce_scalar(std::span<const float> samples) {
+    DAQ_Aggregate aggregate;
+    for (const float sample : samples) {
+        aggregate.min = std::min(aggregate.min, sample);
+        aggregate.max = std::max(aggregate.max, sample);
+        aggregate.sum += sample;
+    }
+    aggregate.count = samples.size();
+    if (!samples.empty()) {
+        aggregate.last = samples.back();
+    }
+    return aggregate;
+}
+
+// Same result (up to the rounding of the sum) with SSE2, 16 samples per iteration in 4 independent accumulators of 4 lanes, so the
+// additions do not wait on each other. SSE2 is part of x86-64, anything else falls back to the scalar loop.
+inline DAQ_Aggregate daq_reduce(std::span<const float> samples) {
+#if defined(__SSE2__)
+    constexpr size_t BLOCK = 16;
+    if (samples.size() < BLOCK) {
+        return daq_reduce_scalar(samples);
+    }
+
+    const float *data = samples.data();
+    const size_t blocks_end = samples.size() / BLOCK * BLOCK;
+
+    __m128 min = _mm_loadu_ps(data);
+    __m128 max = min;
+    // The block sums stay small enough for float, they are widened to double every block
+    __m128d sum_low = _mm_setzero_pd();
+    __m128d sum_high = _mm_setzero_pd();
+
+    for (size_t i = 0; i < blocks_end; i += BLOCK) {
+        const __m128 a = _mm_loadu_ps(data + i);
+        const __m128 b = _mm_loadu_ps(data + i + 4);
+        const __m128 c = _mm_loadu_ps(data + i + 8);
+        const __m128 d = _mm_loadu_ps(data + i + 12);
+
+        min = _mm_min_ps(min, _mm_min_ps(_mm_min_ps(a, b), _mm_min_ps(c, d)));
+        max = _mm_max_ps(max, _mm_max_ps(_mm_max_ps(a, b), _mm_max_ps(c, d)));
+
+        const __m128 block_sum = _mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d));
+        sum_low = _mm_add_pd(sum_low, _mm_cvtps_pd(block_sum));
+        sum_high = _mm_add_pd(sum_high, _mm_cvtps_pd(_mm_movehl_ps(block_sum, block_sum)));
+    }
+
+    // Fold the 4 lanes
+    alignas(16) float min_lanes[4];
+    alignas(16) float max_lanes[4];
+    alignas(16) double sum_lanes[2];
+    _mm_store_ps(min_lanes, min);
+    _mm_store_ps(max_lanes, max);
+    _mm_store_pd(sum_lanes, _mm_add_pd(sum_low, sum_high));
+
+    DAQ_Aggregate aggregate = daq_reduce_scalar(samples.subspan(blocks_end));
+    aggregate.min = std::min({aggregate.min, min_lanes[0], min_lanes[1], min_lanes[2], min_lanes[3]});
+    aggregate.max = std::max({aggregate.max, max_lanes[0], max_lanes[1], max_lanes[2], max_lanes[3]});
+    aggregate.sum += sum_lanes[0] + sum_lanes[1];
+    aggregate.count = samples.size();
+    aggregate.last = samples.back();
+    return aggregate;
+#else
+    return daq_reduce_scalar(samples);
+#endif
+}
+
+// One window, e.g. "the past 10 seconds"
+class DAQ_Window_Aggregator {
+
+public:
+    static constexpr size_t SUB_BUCKETS = 10;
+
+    explicit DAQ_Window_Aggregator(const std::chrono::nanoseconds window) :
+        _window(window), _width_ns(std::max<int64_t>(1, window.count() / static_cast<int64_t>(SUB_BUCKETS))) {
+        _epochs.fill(-1);
+    };
+
+    void add(const DAQ_Aggregate &block, const std::chrono::steady_clock::time_point now) {
+        const int64_t epoch = _epoch(now);
+        const size_t slot = static_cast<size_t>(epoch) % SUB_BUCKETS;
+        if (_epochs[slot] != epoch) {
+            _epochs[slot] = epoch;
+            _buckets[slot] = DAQ_Aggregate {};
+        }
+        _buckets[slot].merge(block);
+    }
+
+    // Everything added during the window ending at now, merged oldest first
+    DAQ_Aggregate query(const std::chrono::steady_clock::time_point now) const {
+        const int64_t current = _epoch(now);
+        DAQ_Aggregate aggregate;
+        for (int64_t epoch = current - static_cast<int64_t>(SUB_BUCKETS) + 1; epoch <= current; epoch++) {
+            if (epoch < 0) {
+                continue;
+            }
+            const size_t slot = static_cast<size_t>(epoch) % SUB_BUCKETS;
+            if (_epochs[slot] == epoch) {
+                aggregate.merge(_buckets[slot]);
+            }
+        }
+        return aggregate;
+    }
+
+    std::chrono::nanoseconds window() const { return _window; }
+
+private:
+    int64_t _epoch(const std::chrono::steady_clock::time_point time) const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count() / _width_ns;
+    }
+
+    std::chrono::nanoseconds _window;
+    int64_t _width_ns;
+    std::array<DAQ_Aggregate, SUB_BUCKETS> _buckets {};
+    std::array<int64_t, SUB_BUCKETS> _epochs {};
+};
+
+// Several windows over the same stream. Not thread safe, add() and query() have to be serialised by the caller
+class DAQ_Aggregator {
+
+public:
+    explicit DAQ_Aggregator(const std::vector<std::chrono::milliseconds> &windows) {
+        _windows.reserve(windows.size());
+        for (const std::chrono::milliseconds window : windows) {
+            _windows.emplace_back(window);
+        }
+    };
+
+    // The whole block is stamped with now, which is what get_latest_data() gives us: everything that arrived since the last tick
+    void add(std::span<const float> samples, const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) {
+        if (samples.empty()) {
+            return;
+        }
+        // Reduced once, then merged into every window
+        const DAQ_Aggregate block = daq_reduce(samples);
+        for (DAQ_Window_Aggregator &window : _windows) {
+            window.add(block, now);
+        }
+    }
+
+    // window_index follows the order given to the constructor. An empty aggregate if the index is out of range
+    DAQ_Aggregate query(const size_t window_index,
+                        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) const {
+        if (window_index >= _windows.size()) {
+            return {};
+        }
+        return _windows[window_index].query(now);
+    }
+
+    size_t window_count() const { return _windows.size(); }
+    std::chrono::nanoseconds window(const size_t window_index) const { return _windows[window_index].window(); }
+
+private:
+    std::vector<DAQ_Window_Aggregator> _windows;
+};
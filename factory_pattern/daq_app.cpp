@@ -0,0 +1,894 @@
+#include "daq_app.h"
+#include "daq_backend_registry.h"
+
+size_t DAQ_Playback::update_batch(const size_t max_messages, const std::chrono::steady_clock::time_point deadline) {
+
+    if (_finished) {
+        return 0;
+    }
+
+    DAQ_Capture_Record record;
+    const auto now = std::chrono::steady_clock::now();
+    // Only meaningful once the playback has started, the first record below resets it to 0
+    auto elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - _playback_start).count();
+
+    // The consumer only ever frees more room while we run, so this is a lower bound of what fits in our ring
+    const size_t room = Sample_Ring::capacity() - _samples.size();
+    size_t published = 0;
+
+    size_t replayed = 0;
+    for (; replayed < max_messages; replayed++) {
+
+        if (replayed % DEADLINE_CHECK_INTERVAL == DEADLINE_CHECK_INTERVAL - 1 && std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+
+        if (!_reader.record(_next_record, record)) {
+            DAQ_LOG_INFO("{} reached the end of the capture after {} records", protocol_type(), _next_record);
+            _finished = true;
+            break;
+        }
+
+        if (!_started) {
+            _started = true;
+            _first_timestamp_ns = record.timestamp_ns;
+            _playback_start = now;
+            elapsed_ns = 0;
+        }
+
+        // Scale the recorded time line by the playback speed and stop at the first record that is not due yet
+        if (_speed > 0.0) {
+            // A record older than the first one (e.g. a capture written with a wall clock that stepped back) is due right away
+            const uint64_t offset_ns = record.timestamp_ns > _first_timestamp_ns ? record.timestamp_ns - _first_timestamp_ns : 0;
+            const double due_ns = static_cast<double>(offset_ns) / _speed;
+            if (due_ns > static_cast<double>(elapsed_ns)) {
+                break;
+            }
+        }
+
+        // Leave the record for the next update if its samples might not fit, unless it is the first one: a record larger than the
+        // whole ring could never be replayed otherwise
+        if (published > 0 && published + _max_samples(record) > room) {
+            break;
+        }
+
+        _replay(record);
+        _next_record++;
+
+        // The decoders published into their own rings, forward everything as if we had decoded it ourselves. After every record,
+        // so that a decoder ring never holds more than one record worth of samples
+        published += forward_samples(_udp_decoder);
+        published += forward_samples(_mavlink_decoder);
+    }
+
+    return replayed;
+}
+
+size_t DAQ_Playback::_max_samples(const DAQ_Capture_Record &record) {
+
+    switch (static_cast<DAQ_Protocol>(record.protocol)) {
+        case DAQ_Protocol::UDP:
+            return record.payload.size() / sizeof(float);
+        case DAQ_Protocol::MAVLINK:
+            // 3 samples per ATTITUDE, at most one per smallest possible frame, plus the frame the framer may have carried over
+            return 3 * (record.payload.size() / (MAVLINK_HEADER_LEN + MAVLINK_CHECKSUM_LEN) + 1);
+        default:
+            return 0;
+    }
+}
+
+void DAQ_Playback::_replay(const DAQ_Capture_Record &record) {
+
+    switch (static_cast<DAQ_Protocol>(record.protocol)) {
+        case DAQ_Protocol::UDP: {
+            const DAQ_UDP_Socket::Packet packet = record.payload;
+            _udp_decoder.parse_udp_packets(std::span<const DAQ_UDP_Socket::Packet>(&packet, 1));
+            break;
+        }
+        case DAQ_Protocol::MAVLINK:
+            _mavlink_decoder.parse_mavlink_bytes(record.payload);
+            break;
+        default:
+            break;
+    }
+}
+
+size_t DAQ_Simulation::update_batch(const size_t max_messages, const std::chrono::steady_clock::time_point deadline) {
+
+    const DAQ_Traffic_Config &config = _generator.config();
+    size_t budget = max_messages;
+
+    // Never generate more than fits in what is left of the sample ring, like playback: at full speed the generator easily outpaces
+    // the application, and everything past the ring would only be generated to be dropped. A message is at most
+    // MAX_MESSAGE_SIZE / 4 samples, far less than the ring, so this only ever waits for the application to drain it
+    const size_t samples_per_message = config.type == DAQ_Traffic_Type::UDP_SAMPLES
+                                           ? std::min(config.payload_size, DAQ_Traffic_Generator::MAX_MESSAGE_SIZE) / sizeof(float)
+                                           : 3;
+    if (samples_per_message > 0) {
+        budget = std::min(budget, (Sample_Ring::capacity() - _samples.size()) / samples_per_message);
+    }
+
+    if (config.messages_per_second > 0.0) {
+        const auto now = std::chrono::steady_clock::now();
+        _tokens += std::chrono::duration<double>(now - _last_refill).count() * config.messages_per_second;
+        _last_refill = now;
+
+        // Do not let an idle period build up an unbounded backlog
+        const double max_tokens = static_cast<double>(std::max<size_t>(config.burst_size, MAX_MESSAGES_PER_UPDATE));
+        _tokens = std::min(_tokens, max_tokens);
+
+        // Only whole bursts are released
+        const size_t burst = std::max<size_t>(config.burst_size, 1);
+        const size_t bursts = static_cast<size_t>(_tokens) / burst;
+        budget = std::min(budget, bursts * burst);
+        _tokens -= static_cast<double>(budget);
+    }
+
+    size_t generated = 0;
+    for (; generated < budget; generated++) {
+
+        if (generated % DEADLINE_CHECK_INTERVAL == DEADLINE_CHECK_INTERVAL - 1 && std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+
+        std::span<const uint8_t> message = _generator.next_message();
+        _generated_bytes += message.size();
+
+        if (config.type == DAQ_Traffic_Type::UDP_SAMPLES) {
+            const DAQ_UDP_Socket::Packet packet = message;
+            _udp_decoder.parse_udp_packets(std::span<const DAQ_UDP_Socket::Packet>(&packet, 1));
+            forward_samples(_udp_decoder);
+        } else {
+            _mavlink_decoder.parse_mavlink_bytes(message);
+            forward_samples(_mavlink_decoder);
+        }
+    }
+
+    // Whatever the deadline cut short is still owed, give it back to the bucket
+    if (config.messages_per_second > 0.0) {
+        _tokens += static_cast<double>(budget - generated);
+    }
+
+    return generated;
+}
+
+size_t DAQ_UDP::receive_udp_packets(const size_t max_packets) {
+
+    if (!_socket.is_open()) {
+        return 0;
+    }
+
+    const size_t truncated_before = _socket.truncated();
+    std::span<const DAQ_UDP_Socket::Packet> packets = _socket.receive_batch(max_packets);
+    // Too large for our buffers, the socket dropped them. They still came out of the socket, so they count towards the batch
+    const size_t truncated = _socket.truncated() - truncated_before;
+    _metrics->add_parse_errors(truncated);
+
+    for (const DAQ_UDP_Socket::Packet &packet : packets) {
+        record_raw(DAQ_Protocol::UDP, packet);
+    }
+    parse_udp_packets(packets);
+
+    return packets.size() + truncated;
+}
+
+void DAQ_UDP::parse_udp_packets(std::span<const DAQ_UDP_Socket::Packet> packets) {
+
+    for (const DAQ_UDP_Socket::Packet &packet : packets) {
+
+        _metrics->add_messages(1, packet.size());
+        if (packet.size() % sizeof(float) != 0) {
+            _metrics->add_parse_errors(1);
+        }
+
+        // memcpy rather than casting the pointer, the payload has no alignment guarantee
+        for (size_t offset = 0; offset + sizeof(float) <= packet.size(); offset += sizeof(float)) {
+            float sample;
+            std::memcpy(&sample, packet.data() + offset, sizeof(float));
+            publish_sample(sample);
+        }
+
+        if (_sample_store != nullptr) {
+            _store_rows(packet);
+        }
+    }
+}
+
+void DAQ_UDP::_store_rows(const DAQ_UDP_Socket::Packet packet) {
+
+    const size_t channels = _sample_store->channels();
+    const size_t row_bytes = channels * sizeof(float);
+    // Small enough for the stack, anything wider is cut at this many channels
+    std::array<float, 64> row;
+    const size_t stored_channels = std::min(channels, row.size());
+
+    for (size_t offset = 0; offset + row_bytes <= packet.size(); offset += row_bytes) {
+        std::memcpy(row.data(), packet.data() + offset, stored_channels * sizeof(float));
+        store_row(std::span<const float>(row.data(), stored_channels));
+    }
+}
+
+size_t DAQ_Mavlink::receive_mavlink_packets(const size_t max_packets) {
+
+    if (!_socket.is_open()) {
+        return 0;
+    }
+
+    const size_t truncated_before = _socket.truncated();
+    std::span<const DAQ_UDP_Socket::Packet> packets = _socket.receive_batch(max_packets);
+    // A truncated datagram would cut its last frame short, the socket dropped it
+    const size_t truncated = _socket.truncated() - truncated_before;
+    _metrics->add_parse_errors(truncated);
+
+    for (const DAQ_UDP_Socket::Packet &packet : packets) {
+        record_raw(DAQ_Protocol::MAVLINK, packet);
+        parse_mavlink_bytes(packet);
+    }
+
+    return packets.size() + truncated;
+}
+
+void DAQ_Mavlink::parse_mavlink_bytes(std::span<const uint8_t> bytes) {
+
+    const size_t errors_before = _parser.crc_errors() + _parser.unknown_messages();
+    const size_t frames = _parser.parse(bytes, [this](const DAQ_Mavlink_Frame &frame) { _handle_frame(frame); });
+
+    _metrics->add_messages(frames, bytes.size());
+    _metrics->add_parse_errors(_parser.crc_errors() + _parser.unknown_messages() - errors_before);
+}
+
+void DAQ_Mavlink::_handle_frame(const DAQ_Mavlink_Frame &frame) {
+
+    // The payload may have been truncated (trailing zeros are not sent), so copy it into a zeroed message sized buffer first
+    std::array<uint8_t, MAVLINK_MAX_PAYLOAD_LEN> payload {};
+    std::memcpy(payload.data(), frame.payload.data(), frame.payload.size());
+
+    switch (frame.msg_id) {
+        case MAVLINK_MSG_ID_HEARTBEAT:
+            listen_to_heartbeat(frame);
+            break;
+        case MAVLINK_MSG_ID_ATTITUDE: {
+            // ATTITUDE: time_boot_ms (uint32), roll, pitch, yaw (float, rad), ...
+            float attitude[3];
+            std::memcpy(attitude, payload.data() + sizeof(uint32_t), sizeof(attitude));
+            publish_sample(attitude[0]);
+            publish_sample(attitude[1]);
+            publish_sample(attitude[2]);
+            // Channels roll, pitch, yaw
+            store_row(attitude);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void DAQ_Mavlink::listen_to_heartbeat(const DAQ_Mavlink_Frame &frame) {
+
+    if (_heartbeats_received == 0 || frame.sysid != _last_heartbeat_sysid) {
+        DAQ_LOG_INFO("{} heartbeat from system {} component {}", protocol_type(), frame.sysid, frame.compid);
+    }
+
+    _last_heartbeat_sysid = frame.sysid;
+    ++_heartbeats_received;
+}
+
+bool DAQ_Mavlink::queue_message(const uint32_t msg_id, std::span<const uint8_t> payload) {
+
+    if (payload.size() > MAVLINK_MAX_PAYLOAD_LEN || stop_requested()) {
+        return false;
+    }
+
+    uint8_t *buffer = _tx_pool.acquire();
+    if (buffer == nullptr) {
+        return false;
+    }
+    std::memcpy(buffer, payload.data(), payload.size());
+
+    if (!_tx_queue.try_push({buffer, msg_id, static_cast<uint16_t>(payload.size())})) {
+        _tx_pool.release_local(buffer);
+        return false;
+    }
+
+    if (_tx_event_fd >= 0) {
+        const uint64_t one = 1;
+        [[maybe_unused]] const ssize_t written = ::write(_tx_event_fd, &one, sizeof(one));
+    }
+    return true;
+}
+
+void DAQ_Mavlink::send_mavlink_packets() {
+
+    if (_tx_event_fd >= 0) {
+        // Reset the eventfd before draining, so a message queued while we drain wakes us up again
+        uint64_t count;
+        [[maybe_unused]] const ssize_t read = ::read(_tx_event_fd, &count, sizeof(count));
+    }
+
+    std::array<uint8_t, MAVLINK_MAX_FRAME_LEN> frame;
+    _tx_queue.drain([&](const Outgoing_Message &message) {
+        const size_t length = mavlink_pack_frame(frame, _seq++, _sysid, _compid, message.msg_id,
+                                                 std::span<const uint8_t>(message.payload, message.length));
+        if (length > 0 && _socket.is_open() && _target_port != 0) {
+            _socket.send_to(_target_address.c_str(), _target_port, std::span<const uint8_t>(frame.data(), length));
+        }
+        // The buffer goes back to the queueing thread, which owns the pool
+        _tx_pool.release(message.payload);
+    });
+}
+
+void DAQ_Mavlink::send_heartbeat() {
+
+    if (!_socket.is_open() || _target_port == 0) {
+        return;
+    }
+
+    // HEARTBEAT: custom_mode (uint32), type, autopilot, base_mode, system_status, mavlink_version
+    // type = MAV_TYPE_GCS (6), autopilot = MAV_AUTOPILOT_INVALID (8), system_status = MAV_STATE_ACTIVE (4)
+    const uint8_t payload[9] = {0, 0, 0, 0, 6, 8, 0, 4, 3};
+
+    std::array<uint8_t, MAVLINK_MAX_FRAME_LEN> frame;
+    const size_t length = mavlink_pack_frame(frame, _seq++, _sysid, _compid, MAVLINK_MSG_ID_HEARTBEAT, payload);
+
+    _socket.send_to(_target_address.c_str(), _target_port, std::span<const uint8_t>(frame.data(), length));
+}
+
+// The protocol backends register themselves, playback and simulation are created by their own init flavour since they need arguments
+DAQ_REGISTER_BACKEND("mavlink", DAQ_Protocol::MAVLINK, DAQ_Mavlink);
+DAQ_REGISTER_BACKEND("udp", DAQ_Protocol::UDP, DAQ_UDP);
+
+std::unique_ptr<DAQ_Backend> DAQ_App::_create_backend(DAQ_Protocol protocol) {
+
+    std::unique_ptr<DAQ_Backend> backend = DAQ_Backend_Registry::instance().create(protocol);
+    if (backend == nullptr) {
+        DAQ_LOG_INFO("Protocol provided either does not exist or has not been implemented");
+    }
+    return backend;
+}
+
+// Runs task(i) for every i in [0, count) on a thread of its own and waits until they are all done, or deadline. finished[i] tells
+// which tasks returned in time and succeeded[i] what they returned. The threads are detached from the start: a task that misses the
+// deadline keeps running in the background, so whatever it touches has to be kept alive by the caller.
+static void run_parallel_until(const size_t count, std::function<bool(size_t)> task,
+                               const std::chrono::steady_clock::time_point deadline,
+                               std::vector<uint8_t> &finished, std::vector<uint8_t> &succeeded) {
+
+    // Shared with the threads, so it outlives this call if one of them is late
+    struct State {
+        std::mutex mutex;
+        std::condition_variable done;
+        std::vector<uint8_t> finished;
+        std::vector<uint8_t> succeeded;
+        size_t remaining;
+        std::function<bool(size_t)> task;
+    };
+    auto state = std::make_shared<State>();
+    state->finished.assign(count, 0);
+    state->succeeded.assign(count, 0);
+    state->remaining = count;
+    state->task = std::move(task);
+
+    for (size_t i = 0; i < count; i++) {
+        std::thread([state, i] {
+            const bool success = state->task(i);
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->finished[i] = 1;
+            state->succeeded[i] = success;
+            state->remaining--;
+            state->done.notify_one();
+        }).detach();
+    }
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait_until(lock, deadline, [&state] { return state->remaining == 0; });
+    finished = state->finished;
+    succeeded = state->succeeded;
+}
+
+#ifdef ALLOW_MULTIPLE_BACKENDS
+bool DAQ_App::init(const std::vector<DAQ_Protocol> &protocols, const std::chrono::milliseconds timeout) {
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // Creating a backend only allocates it, the slow part (sockets, devices) is in init()
+    std::vector<std::unique_ptr<DAQ_Backend>> candidates;
+    candidates.reserve(protocols.size());
+    for (size_t i = 0; i < protocols.size(); i++) {
+        std::unique_ptr<DAQ_Backend> backend_ptr = _create_backend(protocols[i]);
+        if (backend_ptr == nullptr) {
+            DAQ_LOG_WARN("Fails to create backend for protocol {}", static_cast<int>(protocols[i]));
+            continue;
+        }
+        candidates.push_back(std::move(backend_ptr));
+    }
+
+    // A thread that misses the timeout outlives this function and candidates with it, so it gets its own copy of the pointers
+    std::vector<DAQ_Backend *> backends(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++) {
+        backends[i] = candidates[i].get();
+    }
+
+    std::vector<uint8_t> finished;
+    std::vector<uint8_t> succeeded;
+    run_parallel_until(backends.size(), [backends](const size_t i) { return backends[i]->init(); },
+                       start + timeout, finished, succeeded);
+
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (!finished[i]) {
+            // Its init() is still running on the other thread, so it can neither be used nor destroyed
+            spdlog::error("{} did not initialize within {} ms, leaving it out", backends[i]->protocol_type(), timeout.count());
+            [[maybe_unused]] DAQ_Backend *leaked = candidates[i].release();
+        } else if (!succeeded[i]) {
+            spdlog::error("{} fails to initialize, leaving it out", candidates[i]->protocol_type());
+        } else {
+            _daq_backend_manager.push_back(std::move(candidates[i]));
+        }
+    }
+
+    spdlog::info("Initialized {} of {} backends in {} us", _daq_backend_manager.size(), protocols.size(),
+                 std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+    if (_daq_backend_manager.empty()) {
+        return false;
+    }
+
+    _current_daq_mode = DAQ_Mode::REAL_TIME;
+    _start_backends();
+
+    return true;
+}
+#else
+bool DAQ_App::init(const DAQ_Protocol protocol) {
+
+    _daq_backend = _create_backend(protocol);
+
+    if (_daq_backend == nullptr) {
+        DAQ_LOG_INFO("Fails to initialize the backend. The protocol provided is invalid");
+        return false;
+    }
+
+    DAQ_LOG_INFO("DAQ initialized for the following protocol: {}", _daq_backend->protocol_type());
+
+    if (_daq_backend->init()) {
+        DAQ_LOG_INFO("{} protocol has been initialized", _daq_backend->protocol_type());
+    }
+
+    _current_daq_mode = DAQ_Mode::REAL_TIME;
+    _start_backends();
+
+    return true;
+    // In the init fuction for the application, we need to setup the necessary backend
+}
+#endif // ALLOW_MULTIPLE_BACKENDS
+
+bool DAQ_App::init_playback(const std::string &capture_path, const double speed) {
+
+    auto playback = std::make_unique<DAQ_Playback>(capture_path, speed);
+
+    if (!playback->init()) {
+        spdlog::error("Fails to initialize playback of {}", capture_path);
+        return false;
+    }
+
+#ifdef ALLOW_MULTIPLE_BACKENDS
+    _daq_backend_manager.push_back(std::move(playback));
+#else
+    _daq_backend = std::move(playback);
+#endif
+
+    _current_daq_mode = DAQ_Mode::DATA_PLAYBACK;
+    _start_backends();
+
+    return true;
+}
+
+bool DAQ_App::init_simulation(const std::vector<DAQ_Traffic_Config> &traffic) {
+
+#ifdef ALLOW_MULTIPLE_BACKENDS
+    for (size_t i = 0; i < traffic.size(); i++) {
+        auto simulation = std::make_unique<DAQ_Simulation>(traffic[i]);
+        simulation->init();
+        _daq_backend_manager.push_back(std::move(simulation));
+    }
+#else
+    if (traffic.empty()) {
+        return false;
+    }
+    _daq_backend = std::make_unique<DAQ_Simulation>(traffic.front());
+    _daq_backend->init();
+#endif
+
+    _current_daq_mode = DAQ_Mode::SIMULATION;
+    _start_backends();
+
+    return true;
+}
+
+bool DAQ_App::is_playback_finished() const {
+
+    if (_current_daq_mode != DAQ_Mode::DATA_PLAYBACK) {
+        return false;
+    }
+
+#ifdef ALLOW_MULTIPLE_BACKENDS
+    return static_cast<const DAQ_Playback *>(_daq_backend_manager.front().get())->is_finished();
+#else
+    return static_cast<const DAQ_Playback *>(_daq_backend.get())->is_finished();
+#endif
+}
+
+bool DAQ_App::start_recording(const std::string &path) {
+
+    if (_current_daq_mode != DAQ_Mode::REAL_TIME) {
+        DAQ_LOG_WARN("Recording is only supported in real time mode");
+        return false;
+    }
+
+    _recorder = std::make_unique<DAQ_Recorder>();
+    if (!_recorder->open(path)) {
+        _recorder.reset();
+        return false;
+    }
+
+#ifdef ALLOW_MULTIPLE_BACKENDS
+    for (size_t i = 0; i < _daq_backend_manager.size(); i++) {
+        _daq_backend_manager[i]->set_recorder(_recorder.get());
+    }
+#else
+    _daq_backend->set_recorder(_recorder.get());
+#endif
+
+    return true;
+}
+
+void DAQ_App::_start_backends() {
+
+    _latest_data.reserve(_backend_count() * DAQ_Backend::Sample_Ring::capacity());
+
+#if defined(ALLOW_MULTIPLE_BACKENDS) && defined(USE_BACKEND_SCHEDULER)
+    // No point having more workers than backends, they would just sit idle
+    size_t num_workers = std::min<size_t>(std::thread::hardware_concurrency(), _daq_backend_manager.size());
+    _scheduler = std::make_unique<DAQ_Scheduler>(num_workers);
+    spdlog::info("Backend scheduler started with {} workers", _scheduler->num_workers());
+#endif
+#ifdef USE_BACKEND_SCHEDULER
+    // Kept even for a single backend, so set_backend_pinning() works whatever the configuration
+    _backend_pinning.assign(_backend_count(), DAQ_Scheduler::NO_PINNING);
+#endif
+
+    _register_backend_events();
+
+    _is_running = true;
+}
+
+void DAQ_App::update() {
+    std::fill(_backend_ready.begin(), _backend_ready.end(), 1);
+    _update_ready_backends();
+}
+
+size_t DAQ_App::_backend_count() const {
+#ifdef ALLOW_MULTIPLE_BACKENDS
+    return _daq_backend_manager.size();
+#else
+    return 1;
+#endif
+}
+
+DAQ_Backend &DAQ_App::_backend(const size_t index) {
+#ifdef ALLOW_MULTIPLE_BACKENDS
+    return *_daq_backend_manager[index];
+#else
+    (void)index;
+    return *_daq_backend;
+#endif
+}
+
+size_t DAQ_App::_update_ready_backends() {
+
+    const size_t backend_count = _backend_count();
+
+    if (_batch_max_messages == 0) {
+        // One update() per ready backend, each processes whatever it has
+#if defined(ALLOW_MULTIPLE_BACKENDS) && defined(USE_BACKEND_SCHEDULER)
+        for (size_t i = 0; i < backend_count; i++) {
+            if (_backend_ready[i]) {
+                DAQ_Backend *backend = &_backend(i);
+                _scheduler->submit([backend] { daq_backend_update(*backend); }, _backend_pinning[i]);
+                _backend_ready[i] = 0;
+            }
+        }
+        // Wait for every backend to finish this tick so that a backend never has two update() running at the same time
+        _scheduler->wait_idle();
+#else
+        for (size_t i = 0; i < backend_count; i++) {
+            if (_backend_ready[i]) {
+                daq_backend_update(_backend(i));
+                _backend_ready[i] = 0;
+            }
+        }
+#endif
+        return 0;
+    }
+
+    // Batched: rounds of at most _batch_max_messages per backend. A backend that consumed a full batch probably has more waiting and
+    // stays in the next round, the others are done for this tick. Every ready backend gets at least one batch, even past the budget
+    _batch_deadline = std::chrono::steady_clock::now() + _tick_budget;
+    size_t consumed = 0;
+    bool pending = true;
+
+    while (pending) {
+#if defined(ALLOW_MULTIPLE_BACKENDS) && defined(USE_BACKEND_SCHEDULER)
+        for (size_t i = 0; i < backend_count; i++) {
+            if (_backend_ready[i]) {
+                // Only [this, i] is captured, small enough for std::function to store without allocating
+                _scheduler->submit([this, i] {
+                    _batch_consumed[i] = daq_backend_update_batch(_backend(i), _batch_max_messages, _batch_deadline);
+                }, _backend_pinning[i]);
+            }
+        }
+        _scheduler->wait_idle();
+#else
+        for (size_t i = 0; i < backend_count; i++) {
+            if (_backend_ready[i]) {
+                _batch_consumed[i] = daq_backend_update_batch(_backend(i), _batch_max_messages, _batch_deadline);
+            }
+        }
+#endif
+
+        const bool out_of_time = std::chrono::steady_clock::now() >= _batch_deadline;
+        pending = false;
+        for (size_t i = 0; i < backend_count; i++) {
+            if (_backend_ready[i]) {
+                consumed += _batch_consumed[i];
+                _backend_ready[i] = !out_of_time && _batch_consumed[i] >= _batch_max_messages;
+                pending = pending || _backend_ready[i];
+            }
+        }
+    }
+
+    return consumed;
+}
+
+void DAQ_App::_register_backend_events() {
+
+    _reactor = std::make_unique<DAQ_Reactor>();
+
+#ifdef ALLOW_MULTIPLE_BACKENDS
+    for (size_t i = 0; i < _daq_backend_manager.size(); i++) {
+        _daq_backend_manager[i]->register_events(*_reactor, i);
+    }
+    _backend_ready.assign(_daq_backend_manager.size(), 0);
+#else
+    _daq_backend->register_events(*_reactor, 0);
+    _backend_ready.assign(1, 0);
+#endif
+    _batch_consumed.assign(_backend_ready.size(), 0);
+}
+
+size_t DAQ_App::wait_for_events(const int timeout_ms) {
+
+    std::array<uint64_t, DAQ_Reactor::MAX_EVENTS> ready_tokens;
+    const size_t count = _reactor->wait(ready_tokens, timeout_ms);
+
+    // A backend can be woken up by several sources at once (e.g. socket and timer), but must only be updated once
+    size_t backends_ready = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t &ready = _backend_ready[ready_tokens[i]];
+        backends_ready += (ready == 0);
+        ready = 1;
+    }
+
+    _update_ready_backends();
+
+    return backends_ready;
+}
+
+const std::vector<float> &DAQ_App::get_latest_data() {
+
+    // clear() keeps the capacity reserved in init(), so this never allocates
+    _latest_data.clear();
+    auto append = [this](const float sample) { _latest_data.push_back(sample); };
+
+#ifdef ALLOW_MULTIPLE_BACKENDS
+    for (size_t i = 0; i < _daq_backend_manager.size(); i++) {
+        _daq_backend_manager[i]->samples().drain(append);
+    }
+#else
+    _daq_backend->samples().drain(append);
+#endif
+
+    if (_aggregator != nullptr && !_latest_data.empty()) {
+        std::lock_guard<std::mutex> lock(_aggregator_mutex);
+        _aggregator->add(_latest_data);
+    }
+
+    return _latest_data;
+}
+
+void DAQ_App::set_aggregation_windows(const std::vector<std::chrono::milliseconds> &windows) {
+    std::lock_guard<std::mutex> lock(_aggregator_mutex);
+    if (windows.empty()) {
+        _aggregator.reset();
+    } else {
+        _aggregator = std::make_unique<DAQ_Aggregator>(windows);
+    }
+}
+
+DAQ_Sample_Store *DAQ_App::attach_sample_store(const size_t backend_index, const size_t channels, const size_t rows_per_chunk,
+                                               const size_t max_chunks) {
+
+    if (backend_index >= _backend_count()) {
+        return nullptr;
+    }
+
+    _sample_stores.push_back(std::make_unique<DAQ_Sample_Store>(channels, rows_per_chunk, max_chunks));
+    DAQ_Sample_Store *store = _sample_stores.back().get();
+    _backend(backend_index).set_sample_store(store);
+    return store;
+}
+
+DAQ_Aggregate DAQ_App::aggregate(const size_t window_index) const {
+    std::lock_guard<std::mutex> lock(_aggregator_mutex);
+    return _aggregator != nullptr ? _aggregator->query(window_index) : DAQ_Aggregate {};
+}
+
+std::vector<DAQ_Metrics_Snapshot> DAQ_App::metrics_snapshot() const {
+
+    std::vector<DAQ_Metrics_Snapshot> snapshots;
+
+#ifdef ALLOW_MULTIPLE_BACKENDS
+    snapshots.resize(_daq_backend_manager.size());
+    for (size_t i = 0; i < _daq_backend_manager.size(); i++) {
+        _daq_backend_manager[i]->metrics().snapshot(snapshots[i]);
+        snapshots[i].protocol = _daq_backend_manager[i]->protocol_type();
+    }
+#else
+    snapshots.resize(1);
+    _daq_backend->metrics().snapshot(snapshots[0]);
+    snapshots[0].protocol = _daq_backend->protocol_type();
+#endif
+
+    return snapshots;
+}
+
+void DAQ_App::dump_metrics() {
+
+    std::vector<DAQ_Metrics_Snapshot> snapshots = metrics_snapshot();
+
+    std::lock_guard<std::mutex> lock(_metrics_mutex);
+    _log_metrics("metrics", snapshots, _previous_metrics);
+    _previous_metrics = std::move(snapshots);
+}
+
+void DAQ_App::_log_metrics(const char *label, const std::vector<DAQ_Metrics_Snapshot> &snapshots,
+                           const std::vector<DAQ_Metrics_Snapshot> &previous_snapshots) {
+
+    for (size_t i = 0; i < snapshots.size(); i++) {
+        const DAQ_Metrics_Snapshot &current = snapshots[i];
+        const bool has_previous = i < previous_snapshots.size();
+        const DAQ_Metrics_Snapshot *previous = has_previous ? &previous_snapshots[i] : nullptr;
+
+        double seconds = 0.0;
+        uint64_t messages = current.messages;
+        uint64_t bytes = current.bytes;
+        if (previous != nullptr) {
+            seconds = std::chrono::duration<double>(current.time - previous->time).count();
+            messages -= previous->messages;
+            bytes -= previous->bytes;
+        }
+
+        const double message_rate = seconds > 0.0 ? static_cast<double>(messages) / seconds : 0.0;
+        const double byte_rate = seconds > 0.0 ? static_cast<double>(bytes) / seconds : 0.0;
+        const DAQ_Latency_Snapshot &latency = current.update_latency;
+
+        spdlog::info("[{}] {}[{}]: {:.0f} msg/s {:.0f} B/s | {} messages {} bytes {} dropped samples {} parse errors | "
+                     "{} updates, latency p50 {} ns p99 {} ns p999 {} ns max {} ns",
+                     label, current.protocol, i, message_rate, byte_rate, current.messages, current.bytes, current.dropped_samples,
+                     current.parse_errors, current.updates, latency.percentile_ns(0.50), latency.percentile_ns(0.99),
+                     latency.percentile_ns(0.999), latency.max_ns);
+    }
+}
+
+void DAQ_App::start_metrics_dump(const std::chrono::milliseconds period) {
+    {
+        // Baseline, so that the first dump already reports rates, and the final one in shutdown() covers the whole session
+        std::vector<DAQ_Metrics_Snapshot> snapshots = metrics_snapshot();
+        std::lock_guard<std::mutex> lock(_metrics_mutex);
+        _previous_metrics = snapshots;
+        _session_metrics = std::move(snapshots);
+    }
+    _metrics_reporter = std::make_unique<DAQ_Metrics_Reporter>(period, [this] { dump_metrics(); });
+}
+
+bool DAQ_App::shutdown(const std::chrono::milliseconds deadline) {
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto shutdown_deadline = start + deadline;
+
+    // Stop the periodic dump before the backends go away, and give the final numbers once. The periodic dump may have run a moment
+    // ago, rates over that interval would mean nothing, so these are over the whole session
+    if (_metrics_reporter != nullptr) {
+        _metrics_reporter.reset();
+        std::vector<DAQ_Metrics_Snapshot> snapshots = metrics_snapshot();
+        std::lock_guard<std::mutex> lock(_metrics_mutex);
+        _log_metrics("session metrics", snapshots, _session_metrics);
+    }
+
+    _is_running = false;
+    const size_t backend_count = _backend_count();
+
+    // Resolved up front: a thread that misses the deadline keeps running after shutdown() returned, so it must only hold on to the
+    // backend itself and never go through the application again
+    std::vector<DAQ_Backend *> backends(backend_count);
+    for (size_t i = 0; i < backend_count; i++) {
+        backends[i] = &_backend(i);
+    }
+
+    // Tell everyone first, so a slow backend does not delay the others from winding down
+    for (DAQ_Backend *backend : backends) {
+        backend->request_stop();
+    }
+
+    // Cleanup is mostly waiting on the kernel (closing sockets, flushing), so every backend gets a thread of its own rather than a
+    // scheduler worker: the whole shutdown then takes as long as the slowest backend
+    std::vector<uint8_t> done;
+    std::vector<uint8_t> succeeded;
+    run_parallel_until(backend_count, [backends, shutdown_deadline](const size_t i) {
+        DAQ_Backend &backend = *backends[i];
+        const size_t drained = backend.drain(shutdown_deadline);
+        if (drained > 0) {
+            DAQ_LOG_INFO("{} drained {} in-flight messages", backend.protocol_type(), drained);
+        }
+        backend.shutdown();
+        return true;
+    }, shutdown_deadline, done, succeeded);
+
+    bool clean = true;
+    _backend_abandoned.assign(backend_count, 0);
+    for (size_t i = 0; i < backend_count; i++) {
+        if (!done[i]) {
+            spdlog::error("{}[{}] did not shut down within {} ms, abandoning it", backends[i]->protocol_type(), i, deadline.count());
+            _backend_abandoned[i] = 1;
+            clean = false;
+        }
+    }
+
+    // The backends will not record anything anymore, so whatever is still buffered can be flushed to disk, within what is left of
+    // the deadline. An abandoned backend that still tries to is turned away by the closed recorder, which ~DAQ_App() then keeps
+    // alive for it. Same if the disk is too slow and the recorder itself gets abandoned
+    if (_recorder != nullptr && !_recorder->close(shutdown_deadline)) {
+        _recorder_abandoned = true;
+        clean = false;
+    }
+
+    spdlog::info("Shut down {} backends in {} us", backend_count,
+                 std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    return clean;
+}
+
+DAQ_App::~DAQ_App() {
+
+    bool any_abandoned = false;
+    for (size_t i = 0; i < _backend_abandoned.size(); i++) {
+        if (_backend_abandoned[i]) {
+            any_abandoned = true;
+#ifdef ALLOW_MULTIPLE_BACKENDS
+            [[maybe_unused]] DAQ_Backend *leaked = _daq_backend_manager[i].release();
+#else
+            [[maybe_unused]] DAQ_Backend *leaked = _daq_backend.release();
+#endif
+        }
+    }
+
+    // An abandoned backend may still be running and keeps pointers to the recorder (closed, it only turns records away) and to the
+    // sample stores, so those are leaked along with it rather than destroyed under its feet. An abandoned recorder is still used by
+    // its own writer thread
+    if (any_abandoned || _recorder_abandoned) {
+        [[maybe_unused]] DAQ_Recorder *leaked_recorder = _recorder.release();
+    }
+    if (any_abandoned) {
+        for (std::unique_ptr<DAQ_Sample_Store> &store : _sample_stores) {
+            [[maybe_unused]] DAQ_Sample_Store *leaked_store = store.release();
+        }
+    }
+}
@@ -0,0 +1,806 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <cstring>
+#include <span>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <spdlog/spdlog.h>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "daq_aggregator.h"
+#include "daq_buffer_pool.h"
+#include "daq_capture_file.h"
+#include "daq_log.h"
+#include "daq_mavlink_parser.h"
+#include "daq_metrics.h"
+#include "daq_reactor.h"
+#include "daq_recorder.h"
+#include "daq_ring_buffer.h"
+#include "daq_sample_store.h"
+#include "daq_scheduler.h"
+#include "daq_traffic_generator.h"
+#include "daq_udp_socket.h"
+
+/*
+ * In building an application, we want the application to be providing all of the front-end level interface
+ * In the case of a Data Acquisition application, we want to be able to retrieve data using some sort of a backend
+ * that should be abstracted
+ *
+ * In the case of DAQ, you can have different backends that is specific for each protocol since every one of them have different
+ * ways of being setup and initialized (e.g. UDP requires the socket to be binded if server or connected if client)
+ *
+ * We can imagine that for each of this mode, there will always be specific abstract interface that works for all of them. For instance:
+ *   * setup()      - Mode specific implementation for setting up any protocols
+ *   * init()       - Initialize each modes with their channels (setup UART driver etc.)
+ *   * update()     - Handle different messages streaming in (event driven or callbacks)
+ *   * shutdown()   - What happens if the user closes this mode? How do we clear the data? Should we save unsaved data if we are recording the data in real time?
+ *
+ * With that, each of these functions, will need to be purely virtual, defined as follow:
+ *   virtual <return type> <function name> = 0;
+ *
+ * Do not get confused between using only virtual and virtual = 0. The latter means pure virtual which means that each function defined with this
+ * needs to be overriden! As for the former, the user can decide to override them or use the default implementation which can be implemented in the parent class.
+ * If however, you wish to tell the developer that they should not discard the 
+ */
+
+// Uncomment this to see how each backend behaves if we use the default implementation from the backend base class
+#define UDP_OVERRIDE_BACKEND
+#define MAVLINK_OVERRIDE_BACKEND
+
+/*
+In this example, I have created it in such a way that this definition allows you to show the "full" potential of using
+the factory pattern.
+
+In the case of multiple backend, there will be a backend manager, where this will store all of the pointer to our
+respective backend protocols. In this example, I want to have backends for Mavlink and UDP. So, the backend manager will
+respectively initialize both the protocols accordingly, and in the update() function of the application, it will use the abstract
+interface to call the update() function of each backend.
+
+This allows us to be able to add more protocol backends without worrying of breaking the application for as long as the developer
+respects the virtual interface provided (e.g. init(), update(), shutdown()).
+
+If you wish to simplify the example with only a single backend to get a better initial understanding of how it works, uncomment the
+ALLOW_MULTIPLE_BACKENDS definition!
+*/
+#define ALLOW_MULTIPLE_BACKENDS
+
+/*
+With multiple backends, DAQ_App::update() would normally walk the backend manager one by one. This means that if a single backend
+is slow (e.g. UDP socket being flooded), every other backend will have to wait for it to finish. When USE_BACKEND_SCHEDULER is defined,
+each backend update() is handed to a worker pool (see daq_scheduler.h) instead, so the backends run in parallel and the tick only takes
+as long as the slowest backend rather than the sum of all of them.
+
+Comment this out to go back to the serial loop. This only makes sense with ALLOW_MULTIPLE_BACKENDS.
+*/
+#define USE_BACKEND_SCHEDULER
+
+/*
+Calling update() in a tight loop means every backend is polled all the time, even if nothing has arrived. With USE_EVENT_LOOP, each
+backend registers its file descriptors and timers with an epoll instance (see daq_reactor.h) in register_events(), and the application
+calls wait_for_events() instead. This sleeps until something is ready and only calls update() on the backends that have work to do.
+*/
+#define USE_EVENT_LOOP
+
+/*
+NOTE:
+Please note that these examples do not try to handle errors if we fail to initialize the protocol. I try to implement
+everything as "easy" as possible so that you may take this and use as sort of a skeleton to build your application further.
+*/
+
+// Forward declaration
+class DAQ_Backend;
+class DAQ_Mavlink;
+class DAQ_Playback;
+class DAQ_Simulation;
+class DAQ_UDP;
+
+enum class DAQ_Protocol {
+    INVALID = -1,
+    MAVLINK = 0,
+    UDP = 1,
+};
+
+enum class DAQ_Mode {
+    INVALID=-1,
+    REAL_TIME=0,
+    DATA_PLAYBACK = 1,
+    SIMULATION = 2,
+};
+
+class DAQ_App {
+
+public:
+
+    // Upper bound of init() and shutdown() unless told otherwise
+    static constexpr std::chrono::milliseconds DEFAULT_INIT_TIMEOUT {2000};
+    static constexpr std::chrono::milliseconds DEFAULT_SHUTDOWN_DEADLINE {500};
+
+    // DAQ state implementation
+    DAQ_App() = default;
+    // Backends abandoned by shutdown() may still be running on their own thread, they are leaked rather than destroyed under it
+    ~DAQ_App();
+
+#ifdef ALLOW_MULTIPLE_BACKENDS
+    // Creates one backend per protocol and runs all of their init() at the same time, each on a thread of its own, so that opening
+    // many sockets or serial ports takes as long as the slowest one rather than the sum of them. A backend whose init() fails, or
+    // has not returned within timeout, is reported and left out; the others start normally. Returns false if no backend is left.
+    bool init(const std::vector<DAQ_Protocol> &protocols, std::chrono::milliseconds timeout = DEFAULT_INIT_TIMEOUT);
+#else
+    bool init(const DAQ_Protocol protocol);
+#endif
+
+    // DAQ_Mode::DATA_PLAYBACK. Instead of live protocols, replay a capture file (see daq_capture_file.h) through a single
+    // playback backend. speed is a multiplier of the recorded pace (1.0 is real time), 0 replays as fast as possible.
+    bool init_playback(const std::string &capture_path, double speed);
+
+    // DAQ_Mode::SIMULATION. One simulation backend per traffic configuration, generating synthetic traffic in process
+    bool init_simulation(const std::vector<DAQ_Traffic_Config> &traffic);
+
+    // Records the raw data of every backend into a capture file until shutdown(). Only meaningful in DAQ_Mode::REAL_TIME
+    bool start_recording(const std::string &path);
+
+    void update();
+
+    // Stops every backend in parallel, within deadline overall rather than the sum of every backend's cleanup:
+    //   1. every backend is told to stop (request_stop()), so none of them starts new work
+    //   2. each backend, on its own thread, drains what is already in flight (drain()) into its sample ring and the recorder, then
+    //      releases its resources (shutdown())
+    //   3. the recorder is flushed and closed, abandoning the file if the disk has not caught up by the deadline
+    // The samples drained in step 2 are still in the rings: call get_latest_data() once more afterwards to collect them.
+    // A backend that is still busy when the deadline expires is reported and abandoned (never destroyed, see ~DAQ_App()).
+    // Returns true if every backend shut down, and the recording was closed, in time.
+    bool shutdown(std::chrono::milliseconds deadline = DEFAULT_SHUTDOWN_DEADLINE);
+
+    // With batching enabled, update() and wait_for_events() no longer let every backend process "whatever is there" in a single call.
+    // Every backend gets update_batch() calls of at most max_messages_per_batch messages, round robin, for as long as it still has
+    // work and the tick has not used up tick_budget. A flooded backend can then neither starve the others nor make the tick
+    // arbitrarily long, and the quieter backends are serviced at least once per tick. max_messages_per_batch = 0 disables batching.
+    void set_batching(size_t max_messages_per_batch, std::chrono::nanoseconds tick_budget) {
+        _batch_max_messages = max_messages_per_batch;
+        _tick_budget = tick_budget;
+    }
+
+    // Sleeps until at least one backend has something to do (or timeout_ms expires) and only updates those backends.
+    // Returns the number of backends that were updated.
+    size_t wait_for_events(int timeout_ms);
+
+    bool is_running() { return _is_running; };
+    bool is_playback_finished() const;
+
+    void set_running_flag(const bool flag) {
+        _is_running = flag;
+    }
+
+    // API
+    // Drains every sample the backends have published since the last call. The returned reference stays valid until the next call.
+    // Must always be called from the same thread, since that thread is the single consumer of every backend ring.
+    const std::vector<float> &get_latest_data();
+    // Keeps min/max/mean/last of everything get_latest_data() returns over each of the given windows (e.g. 1 s, 10 s, 60 s), see
+    // daq_aggregator.h. Call before the acquisition starts, an empty list turns aggregation off
+    void set_aggregation_windows(const std::vector<std::chrono::milliseconds> &windows);
+    // Aggregate of the window at window_index (order of set_aggregation_windows()), in constant time. Can be called from any thread
+    DAQ_Aggregate aggregate(size_t window_index) const;
+
+    // Attaches a columnar store of channels channels to the backend at backend_index (see daq_sample_store.h). The backend appends a
+    // timestamped row for every complete set of channel values it decodes, and the returned store can be scanned from any thread
+    // while it does. Call before the acquisition starts. The store is a ring of max_chunks chunks of rows_per_chunk rows: once full,
+    // every new chunk retires the oldest one, so it always holds the latest rows and never stops collecting. It lives as long as
+    // the application
+    DAQ_Sample_Store *attach_sample_store(size_t backend_index, size_t channels,
+                                          size_t rows_per_chunk = DAQ_Sample_Store::DEFAULT_ROWS_PER_CHUNK,
+                                          size_t max_chunks = DAQ_Sample_Store::DEFAULT_MAX_CHUNKS);
+    // Period between two acquisitions when driven at a fixed rate (see daq_tick_driver.h)
+    uint32_t get_sample_rate_ms() const { return _sample_rate_ms; };
+    void set_sample_rate_ms(const uint32_t sample_rate_ms) { _sample_rate_ms = std::max<uint32_t>(sample_rate_ms, 1); }
+
+    // Metrics of every backend, in the order of the backend manager. Can be called from any thread while the backends run
+    std::vector<DAQ_Metrics_Snapshot> metrics_snapshot() const;
+    // Logs one line per backend with its counters, rates since the previous dump and update() latency percentiles
+    void dump_metrics();
+    // Calls dump_metrics() every period from a background thread until shutdown()
+    void start_metrics_dump(std::chrono::milliseconds period);
+
+    std::unique_ptr<DAQ_Backend> _create_backend(DAQ_Protocol protocol);
+    // Backends in the order of the backend manager, whether or not ALLOW_MULTIPLE_BACKENDS is defined
+    size_t _backend_count() const;
+    DAQ_Backend &_backend(size_t index);
+
+#ifdef USE_BACKEND_SCHEDULER
+    // Pin the backend (index follows the order of the protocols given to init(), minus the backends that failed) to a specific worker.
+    // Useful for backends that hold on to thread affine resources. Use DAQ_Scheduler::NO_PINNING to let any worker run it.
+    void set_backend_pinning(size_t backend_index, int worker_index) {
+        if (backend_index < _backend_pinning.size()) {
+            _backend_pinning[backend_index] = worker_index;
+        }
+    }
+#endif
+
+#ifdef ALLOW_MULTIPLE_BACKENDS
+    std::vector<std::unique_ptr<DAQ_Backend>> _daq_backend_manager;
+#else
+    std::unique_ptr<DAQ_Backend> _daq_backend;
+#endif // ALLOW_MULTIPLE_BACKENDS
+    
+
+private:
+
+    // Variable that stores the backend pointer
+    DAQ_Mode _current_daq_mode = DAQ_Mode::INVALID;
+    bool _is_running = false;
+    uint32_t _sample_rate_ms = 10;
+
+    // Common to every init flavour, once the backends have been created
+    void _start_backends();
+
+    // Runs every backend flagged in _backend_ready (and clears the flags). Returns the number of messages the batches consumed
+    size_t _update_ready_backends();
+
+    size_t _batch_max_messages = 0;
+    std::chrono::nanoseconds _tick_budget {0};
+    std::chrono::steady_clock::time_point _batch_deadline;
+    // Messages consumed by the last batch of every backend, reserved once so batching never allocates
+    std::vector<size_t> _batch_consumed;
+
+    // Reserved once in init() to hold a full ring of every backend, so draining never allocates
+    std::vector<float> _latest_data;
+
+    // Fed by get_latest_data(), queried by anyone
+    mutable std::mutex _aggregator_mutex;
+    std::unique_ptr<DAQ_Aggregator> _aggregator;
+
+    std::vector<std::unique_ptr<DAQ_Sample_Store>> _sample_stores;
+
+    // Shared by every backend, they all append to the same capture file
+    std::unique_ptr<DAQ_Recorder> _recorder;
+    // Set by shutdown() if the recorder did not close before the deadline
+    bool _recorder_abandoned = false;
+
+    // Previous snapshot of every backend, to turn the counters into rates in dump_metrics()
+    std::mutex _metrics_mutex;
+    std::vector<DAQ_Metrics_Snapshot> _previous_metrics;
+    // Taken by start_metrics_dump(), for the final dump of shutdown()
+    std::vector<DAQ_Metrics_Snapshot> _session_metrics;
+    std::unique_ptr<DAQ_Metrics_Reporter> _metrics_reporter;
+    // One line per backend with the rates between previous_snapshots and snapshots. Called with _metrics_mutex held
+    void _log_metrics(const char *label, const std::vector<DAQ_Metrics_Snapshot> &snapshots,
+                      const std::vector<DAQ_Metrics_Snapshot> &previous_snapshots);
+
+    // Every backend registers its event sources with the reactor, using its index in the backend manager as token
+    void _register_backend_events();
+    std::unique_ptr<DAQ_Reactor> _reactor;
+    std::vector<uint8_t> _backend_ready;
+
+    // Set by shutdown() for the backends that missed the deadline
+    std::vector<uint8_t> _backend_abandoned;
+
+#ifdef USE_BACKEND_SCHEDULER
+    std::unique_ptr<DAQ_Scheduler> _scheduler;
+    std::vector<int> _backend_pinning;
+#endif
+
+};
+
+class DAQ_Backend {
+
+// friend is important to be able to access protected members of the backend base class
+friend class DAQ_UDP;
+friend class DAQ_Mavlink;
+friend class DAQ_Playback;
+friend class DAQ_Simulation;
+
+public:
+    // Every backend owns one ring. The backend is the only producer (from update()) and DAQ_App is the only consumer
+    using Sample_Ring = DAQ_Ring_Buffer<float, 4096>;
+
+    DAQ_Backend() = default;
+    // Virtual, since the backends are deleted through a DAQ_Backend pointer and most of them own sockets or file descriptors
+    virtual ~DAQ_Backend() = default;
+
+    // Abstract function that each function should have in their backend implementation
+    virtual void setup() = 0;
+    virtual bool init() {
+        DAQ_LOG_INFO("Using default init() implementation for {}", protocol_type());
+        return true;
+    };
+    virtual void update() {
+        DAQ_LOG_DEBUG("Backend for {} has not been implemented. Using the default update() function.", protocol_type());
+        _metrics->add_messages(1, sizeof(float));
+        const uint64_t backend_counter = _metrics->messages();
+        DAQ_LOG_DEBUG("Backend counter for {}: {}", protocol_type(), backend_counter);
+        publish_sample(static_cast<float>(backend_counter));
+    };
+
+    virtual void shutdown() {
+        DAQ_LOG_INFO("Using default shutdown() implementation for {}", protocol_type());
+    };
+
+    // Called right before shutdown(), from the thread that will shut the backend down: process whatever was already received but
+    // not yet consumed (e.g. datagrams waiting in the socket buffer), without starting anything new, and stop at deadline. Returns
+    // the number of messages drained. Backends without anything in flight have nothing to do.
+    virtual size_t drain(const std::chrono::steady_clock::time_point /* deadline */) { return 0; }
+
+    // Tells the backend that shutdown is coming. Can be called from any thread, while the backend is running
+    void request_stop() { _stop_requested.store(true, std::memory_order_relaxed); }
+    bool stop_requested() const { return _stop_requested.load(std::memory_order_relaxed); }
+
+    // Processes at most max_messages messages, and stops early once deadline has passed. Returns the number of messages consumed: if
+    // that is max_messages, the backend most likely has more waiting. What a message is depends on the backend (a datagram for the
+    // socket backends, a record for playback, ...). The default runs a single update() and reports what it counted in its metrics.
+    virtual size_t update_batch(const size_t /* max_messages */, const std::chrono::steady_clock::time_point /* deadline */) {
+        const uint64_t messages_before = _metrics->messages();
+        update();
+        return static_cast<size_t>(_metrics->messages() - messages_before);
+    }
+
+    // Register the file descriptors and timers that should trigger update() with the application reactor. The token has to be
+    // given back to the reactor as is. Backends without anything to wait on are simply polled with a timer by default.
+    virtual void register_events(DAQ_Reactor &reactor, const uint64_t token) {
+        reactor.add_timer(std::chrono::milliseconds(100), token);
+    }
+
+    virtual const char *protocol_type() const = 0;
+
+    Sample_Ring &samples() { return _samples; }
+    size_t dropped_samples() const { return _metrics->dropped_samples(); }
+
+    // Counters and update() latencies of this backend, see daq_metrics.h
+    DAQ_Backend_Metrics &metrics() { return *_metrics; }
+    const DAQ_Backend_Metrics &metrics() const { return *_metrics; }
+
+    // The recorder is owned by the application, the backend only appends to it
+    void set_recorder(DAQ_Recorder *recorder) { _recorder = recorder; }
+    // Same for the sample store, the backend is its single writer. Virtual so that the backends built on decoders can pass it on
+    virtual void set_sample_store(DAQ_Sample_Store *store) { _sample_store = store; }
+
+protected:
+    // Called by the backend from update(). Never blocks, if the application is not reading fast enough the sample is dropped
+    void publish_sample(const float sample) {
+        if (!_samples.try_push(sample)) {
+            _metrics->add_dropped_samples(1);
+        }
+    }
+
+    // Moves everything another backend published into our own ring. Used by the backends that reuse the parsing code of the
+    // protocol backends (playback, simulation) by feeding a DAQ_UDP or DAQ_Mavlink that has no socket. Returns the number of samples
+    // moved (dropped ones included)
+    size_t forward_samples(DAQ_Backend &decoder) {
+        return decoder.samples().drain([this](const float sample) { publish_sample(sample); });
+    }
+
+    // Called by the backend with the raw bytes it received, before parsing, so that playback can go through the parser again
+    void record_raw(const DAQ_Protocol protocol, std::span<const uint8_t> bytes) {
+        if (_recorder != nullptr) {
+            _recorder->record(static_cast<uint16_t>(protocol), bytes);
+        }
+    }
+
+    // Appends one row of channel values to the sample store, if any, stamped with the steady clock
+    void store_row(std::span<const float> values) {
+        if (_sample_store != nullptr) {
+            const auto now = std::chrono::steady_clock::now().time_since_epoch();
+            _sample_store->append(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()), values);
+        }
+    }
+
+    // The decoders owned by another backend (playback, simulation) count into the metrics of their owner, so that the messages,
+    // drops and parse errors show up under the backend that is actually running
+    void share_metrics_with(DAQ_Backend &decoder) { decoder._metrics = _metrics; }
+
+    DAQ_Backend_Metrics _own_metrics;
+    DAQ_Backend_Metrics *_metrics = &_own_metrics;
+    Sample_Ring _samples;
+    DAQ_Recorder *_recorder = nullptr;
+    DAQ_Sample_Store *_sample_store = nullptr;
+    std::atomic<bool> _stop_requested {false};
+};
+
+// Runs one update() of the backend and records how long it took. Templated on the backend type, so that the call stays a direct
+// (devirtualized) call when the concrete type is known, e.g. in DAQ_Static_Manager
+template <typename Backend>
+void daq_backend_update(Backend &backend) {
+    const auto start = std::chrono::steady_clock::now();
+    backend.update();
+    const auto duration = std::chrono::steady_clock::now() - start;
+    backend.metrics().record_update(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+}
+
+// Same for update_batch(), the latency histogram then tells how long a single batch takes
+template <typename Backend>
+size_t daq_backend_update_batch(Backend &backend, const size_t max_messages, const std::chrono::steady_clock::time_point deadline) {
+    const auto start = std::chrono::steady_clock::now();
+    const size_t consumed = backend.update_batch(max_messages, deadline);
+    const auto duration = std::chrono::steady_clock::now() - start;
+    backend.metrics().record_update(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+    return consumed;
+}
+
+// For update() implemented on top of update_batch()
+constexpr size_t DAQ_UNLIMITED_MESSAGES = SIZE_MAX;
+
+class DAQ_UDP final : public DAQ_Backend {
+
+public:
+    static constexpr uint16_t DEFAULT_PORT = 15000;
+    static constexpr size_t RX_BUFFER_SIZE = 2048;
+
+    explicit DAQ_UDP(const uint16_t port = DEFAULT_PORT) : _port(port) {};
+    ~DAQ_UDP() = default;
+
+    // Overriding the virtual function from parent class
+    void setup() override {};
+
+
+#ifdef UDP_OVERRIDE_BACKEND
+    bool init() override {
+        DAQ_LOG_INFO("{} init() function. Initialize protocol specific socket/implementation.", protocol_type());
+        return _socket.open("0.0.0.0", _port, RX_BUFFER_SIZE);
+    };
+    void update() override {
+        DAQ_LOG_DEBUG("{} update() function. Process data here.", protocol_type());
+        // Keep draining until the kernel has nothing left for us
+        update_batch(DAQ_UNLIMITED_MESSAGES, std::chrono::steady_clock::time_point::max());
+    };
+    size_t update_batch(const size_t max_messages, const std::chrono::steady_clock::time_point deadline) override {
+        size_t consumed = 0;
+        while (consumed < max_messages) {
+            const size_t requested = std::min(max_messages - consumed, DAQ_UDP_Socket::BATCH_SIZE);
+            const size_t received = receive_udp_packets(requested);
+            consumed += received;
+            // A batch smaller than requested means the socket is empty
+            if (received < requested || std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+        }
+        return consumed;
+    }
+    // Whatever the kernel already buffered for us still gets parsed (and recorded)
+    size_t drain(const std::chrono::steady_clock::time_point deadline) override {
+        return update_batch(DAQ_UNLIMITED_MESSAGES, deadline);
+    }
+    void shutdown() override {
+        DAQ_LOG_INFO("{} shutdown() function. Implement protocol specific cleanup here.", protocol_type());
+        _socket.close();
+    };
+    void register_events(DAQ_Reactor &reactor, const uint64_t token) override {
+        reactor.add_fd(_socket.fd(), token);
+    }
+#endif
+
+    const char *protocol_type() const override { return "UDP"; }
+
+    // Protocol specific functions or variables
+    // Please read my notes on protocol specific functions in DAQ_Mavlink
+
+    // Every datagram is a sequence of little endian float samples. The packets point straight into the receive buffers of the socket.
+    // With a sample store attached, every complete group of channels samples in a datagram is one row
+    void parse_udp_packets(std::span<const DAQ_UDP_Socket::Packet> packets);
+    // Reads one batch of datagrams with a single recvmmsg() and parses them. Returns the number of datagrams received, including
+    // the ones too large for RX_BUFFER_SIZE, which are dropped and counted as parse errors
+    size_t receive_udp_packets(size_t max_packets = DAQ_UDP_Socket::BATCH_SIZE);
+
+    uint16_t local_port() const { return _socket.local_port(); }
+    size_t parse_errors() const { return _metrics->parse_errors(); }
+
+private:
+    void _store_rows(DAQ_UDP_Socket::Packet packet);
+
+    uint16_t _port;
+    DAQ_UDP_Socket _socket;
+
+};
+
+class DAQ_Mavlink final : public DAQ_Backend {
+
+public:
+    static constexpr uint16_t DEFAULT_PORT = 14550;
+    static constexpr size_t RX_BUFFER_SIZE = 2048;
+    // Messages queued with queue_message() that have not been sent yet
+    static constexpr size_t TX_QUEUE_CAPACITY = 64;
+
+    explicit DAQ_Mavlink(const uint16_t port = DEFAULT_PORT) : _port(port) {};
+    ~DAQ_Mavlink() { _close_tx_event(); }
+
+    // Overriding the virtual function from parent class
+    void setup() override {};
+
+#ifdef MAVLINK_OVERRIDE_BACKEND
+    bool init() override {
+        DAQ_LOG_INFO("{} init() function. Initialize protocol specific socket/implementation.", protocol_type());
+        _tx_event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        return _socket.open("0.0.0.0", _port, RX_BUFFER_SIZE);
+    }
+    void update() override {
+        DAQ_LOG_DEBUG("{} update() function. Process data here.", protocol_type());
+        update_batch(DAQ_UNLIMITED_MESSAGES, std::chrono::steady_clock::time_point::max());
+    };
+    // The batch limits the datagrams received. Queued messages and the heartbeat are always sent
+    size_t update_batch(const size_t max_messages, const std::chrono::steady_clock::time_point deadline) override {
+        size_t consumed = 0;
+        while (consumed < max_messages) {
+            const size_t requested = std::min(max_messages - consumed, DAQ_UDP_Socket::BATCH_SIZE);
+            const size_t received = receive_mavlink_packets(requested);
+            consumed += received;
+            if (received < requested || std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+        }
+
+        send_mavlink_packets();
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - _last_heartbeat_sent >= HEARTBEAT_PERIOD) {
+            send_heartbeat();
+            _last_heartbeat_sent = now;
+        }
+        return consumed;
+    }
+    size_t drain(const std::chrono::steady_clock::time_point deadline) override {
+        size_t consumed = 0;
+        while (std::chrono::steady_clock::now() < deadline) {
+            const size_t received = receive_mavlink_packets();
+            consumed += received;
+            if (received < DAQ_UDP_Socket::BATCH_SIZE) {
+                break;
+            }
+        }
+        return consumed;
+    }
+    void shutdown() override {
+        DAQ_LOG_INFO("{} shutdown() function. Implement protocol specific cleanup here.", protocol_type());
+        // Whatever is still queued goes out before the socket closes
+        send_mavlink_packets();
+        _socket.close();
+        _close_tx_event();
+    };
+    void register_events(DAQ_Reactor &reactor, const uint64_t token) override {
+        // Woken up by incoming packets, by queued messages, and by the timer so that we keep sending heartbeats when the link is quiet
+        reactor.add_fd(_socket.fd(), token);
+        if (_tx_event_fd >= 0) {
+            reactor.add_fd(_tx_event_fd, token);
+        }
+        reactor.add_timer(HEARTBEAT_PERIOD, token);
+    }
+#endif
+
+    const char *protocol_type() const override { return "Mavlink"; }
+
+    /* 
+     * Protocol specific function that may be important for this specific protocol. This should not be called on the
+     * application level as the application backend does not "know" about the existence of these functions.
+     * These functions should be called with the object of this specific class. For example:
+     * ================================================== 
+     * DAQ_Mavlink daq_mavlink;
+     * ...
+     * ...
+     * daq_mavlink.send_mavlink_packets();
+     * ================================================== 
+     *
+     * This is what you can call public function (aka developer API), if they are using your library. If you wish to hide some
+     * internal function that should only be called within the class, then put it under private!
+     * 
+     * Also, depending on certain protocols (e.g. UART), you may want to consider using singleton.
+     */
+    void send_heartbeat();
+    void listen_to_heartbeat(const DAQ_Mavlink_Frame &frame);
+    // Feeds raw bytes of the MAVLink stream (wherever they come from) through the framer
+    void parse_mavlink_bytes(std::span<const uint8_t> bytes);
+
+    // Queues a message (any msg_id with a known CRC_EXTRA) to be sent to the target on the next update(). The payload is copied into
+    // a pooled buffer, so the caller can reuse its own right away and nothing is allocated. Only one thread at a time may queue
+    // (e.g. the application thread). Returns false if the queue is full, or once the backend has been asked to stop.
+    bool queue_message(uint32_t msg_id, std::span<const uint8_t> payload);
+    // Sends everything queued with queue_message(). Called from update()
+    void send_mavlink_packets();
+
+    // Reads one batch of datagrams and feeds them to the MAVLink framer. Returns the number of datagrams received, truncated ones
+    // included (dropped and counted as parse errors, like for DAQ_UDP)
+    size_t receive_mavlink_packets(size_t max_packets = DAQ_UDP_Socket::BATCH_SIZE);
+
+    // Where send_heartbeat() sends to (e.g. the ground station or the autopilot)
+    void set_target(const std::string &address, const uint16_t port) {
+        _target_address = address;
+        _target_port = port;
+    }
+
+    size_t heartbeats_received() const { return _heartbeats_received; }
+    const DAQ_Mavlink_Parser &parser() const { return _parser; }
+
+private:
+    void _handle_frame(const DAQ_Mavlink_Frame &frame);
+    void _close_tx_event() {
+        if (_tx_event_fd >= 0) {
+            ::close(_tx_event_fd);
+            _tx_event_fd = -1;
+        }
+    }
+
+    struct Outgoing_Message {
+        uint8_t *payload;
+        uint32_t msg_id;
+        uint16_t length;
+    };
+
+    uint16_t _port;
+    // Owned by the thread calling queue_message(), the buffers come back from update() through the return stack of the pool. Never
+    // grows beyond the queue, so a sender that outpaces the link is told so instead of eating memory. Declared before the queue, so
+    // it outlives the buffers in there
+    DAQ_Buffer_Pool _tx_pool {MAVLINK_MAX_PAYLOAD_LEN, TX_QUEUE_CAPACITY, 1};
+    DAQ_Ring_Buffer<Outgoing_Message, TX_QUEUE_CAPACITY> _tx_queue;
+    // Wakes up the event loop when something was queued
+    int _tx_event_fd = -1;
+
+    DAQ_UDP_Socket _socket;
+    DAQ_Mavlink_Parser _parser;
+
+    std::string _target_address;
+    uint16_t _target_port = 0;
+
+    // Our own identity on the MAVLink network (255 is the usual id for ground control stations)
+    uint8_t _sysid = 255;
+    uint8_t _compid = 190;
+    uint8_t _seq = 0;
+
+    static constexpr std::chrono::seconds HEARTBEAT_PERIOD{1};
+    std::chrono::steady_clock::time_point _last_heartbeat_sent {};
+
+    uint8_t _last_heartbeat_sysid = 0;
+    size_t _heartbeats_received = 0;
+
+};
+
+/*
+ * Backend for DAQ_Mode::DATA_PLAYBACK.
+ *
+ * Replays a capture file recorded from live backends. The file is mmap'ed (see DAQ_Capture_Reader), so even captures of several
+ * gigabytes are only paged in as they get replayed. Each record is handed to the parsing code of the protocol it was recorded from
+ * (a DAQ_UDP or DAQ_Mavlink that is never init()'ed, so it has no socket), which means playback exercises exactly the same code path
+ * as live data. That is what makes it useful for regression testing and benchmarking the pipeline.
+ */
+class DAQ_Playback final : public DAQ_Backend {
+
+public:
+    // How many records are replayed between two looks at the clock when a batch has a deadline
+    static constexpr size_t DEADLINE_CHECK_INTERVAL = 32;
+
+    DAQ_Playback(const std::string &capture_path, const double speed) :
+        _capture_path(capture_path), _speed(speed) {
+        share_metrics_with(_udp_decoder);
+        share_metrics_with(_mavlink_decoder);
+    };
+    ~DAQ_Playback() = default;
+
+    void setup() override {};
+
+    bool init() override {
+        if (!_reader.open(_capture_path)) {
+            return false;
+        }
+        // Deferred, like every log of the backends. It can not hold on to a std::string, so the path is left out
+        if (_speed > 0.0) {
+            DAQ_LOG_INFO("{} replaying {} bytes at {}x", protocol_type(), _reader.size_bytes(), _speed);
+        } else {
+            DAQ_LOG_INFO("{} replaying {} bytes at full speed", protocol_type(), _reader.size_bytes());
+        }
+        return true;
+    };
+
+    // One update() replays as many records as are due and whose samples fit in what is left of the sample ring, so that an "as fast
+    // as possible" replay never overflows it. The rest waits for the application to drain the ring
+    void update() override {
+        update_batch(DAQ_UNLIMITED_MESSAGES, std::chrono::steady_clock::time_point::max());
+    }
+    size_t update_batch(size_t max_messages, std::chrono::steady_clock::time_point deadline) override;
+
+    void shutdown() override {
+        DAQ_LOG_INFO("{} replayed {} records", protocol_type(), _next_record);
+        _reader.close();
+    };
+
+    void register_events(DAQ_Reactor &reactor, const uint64_t token) override {
+        reactor.add_timer(std::chrono::milliseconds(1), token);
+    }
+
+    void set_sample_store(DAQ_Sample_Store *store) override {
+        _sample_store = store;
+        _udp_decoder.set_sample_store(store);
+        _mavlink_decoder.set_sample_store(store);
+    }
+
+    const char *protocol_type() const override { return "Playback"; }
+
+    bool is_finished() const { return _finished; }
+
+private:
+    void _replay(const DAQ_Capture_Record &record);
+    // Upper bound of the samples replaying record can publish
+    static size_t _max_samples(const DAQ_Capture_Record &record);
+
+    std::string _capture_path;
+    double _speed;
+    DAQ_Capture_Reader _reader;
+
+    DAQ_UDP _udp_decoder;
+    DAQ_Mavlink _mavlink_decoder;
+
+    size_t _next_record = 0;
+    bool _started = false;
+    bool _finished = false;
+    uint64_t _first_timestamp_ns = 0;
+    std::chrono::steady_clock::time_point _playback_start;
+};
+
+/*
+ * Backend for DAQ_Mode::SIMULATION.
+ *
+ * Generates synthetic UDP or MAVLink traffic in process (see daq_traffic_generator.h) and pushes it through the parsing code of the
+ * matching protocol backend, exactly like playback does with a capture file. Rate, burstiness, payload size and corruption are all
+ * configurable, which makes it possible to load test DAQ_App far beyond what real hardware on the desk would produce.
+ *
+ * The rate is enforced with a token bucket: tokens accumulate at messages_per_second and are spent burst_size at a time. Whatever the
+ * rate, an update() never generates more samples than are free in the sample ring, the rest waits for the application to drain it.
+ */
+class DAQ_Simulation final : public DAQ_Backend {
+
+public:
+    // Upper bound of messages generated per update() so one update() never monopolises a worker
+    static constexpr size_t MAX_MESSAGES_PER_UPDATE = 1024;
+    // How many messages are generated between two looks at the clock when a batch has a deadline
+    static constexpr size_t DEADLINE_CHECK_INTERVAL = 32;
+
+    explicit DAQ_Simulation(const DAQ_Traffic_Config &config) : _generator(config) {
+        share_metrics_with(_udp_decoder);
+        share_metrics_with(_mavlink_decoder);
+    };
+    ~DAQ_Simulation() = default;
+
+    void setup() override {};
+
+    bool init() override {
+        _last_refill = std::chrono::steady_clock::now();
+        return true;
+    };
+
+    void update() override {
+        update_batch(MAX_MESSAGES_PER_UPDATE, std::chrono::steady_clock::time_point::max());
+    }
+    size_t update_batch(size_t max_messages, std::chrono::steady_clock::time_point deadline) override;
+
+    void shutdown() override {
+        DAQ_LOG_INFO("{} generated {} messages ({} bytes, {} corrupted)", protocol_type(), _generator.generated(),
+                     _generated_bytes, _generator.corrupted());
+    };
+
+    void register_events(DAQ_Reactor &reactor, const uint64_t token) override {
+        reactor.add_timer(std::chrono::milliseconds(1), token);
+    }
+
+    void set_sample_store(DAQ_Sample_Store *store) override {
+        _sample_store = store;
+        _udp_decoder.set_sample_store(store);
+        _mavlink_decoder.set_sample_store(store);
+    }
+
+    const char *protocol_type() const override { return "Simulation"; }
+
+    uint64_t generated_messages() const { return _generator.generated(); }
+    uint64_t generated_bytes() const { return _generated_bytes; }
+
+private:
+    DAQ_Traffic_Generator _generator;
+
+    DAQ_UDP _udp_decoder;
+    DAQ_Mavlink _mavlink_decoder;
+
+    double _tokens = 0.0;
+    uint64_t _generated_bytes = 0;
+    std::chrono::steady_clock::time_point _last_refill;
+};
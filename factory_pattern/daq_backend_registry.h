@@ -0,0 +1,180 @@
+#pragma once
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "daq_app.h"
+
+/*
+ * Registry of every backend the application knows how to create, replacing the switch that used to live in
+ * DAQ_App::_create_backend().
+ *
+ * A backend registers a name and a constructor, either:
+ *   * statically, with DAQ_REGISTER_BACKEND next to its definition. The registration runs before main(), so adding a backend to the
+ *     core does not mean touching DAQ_App at all
+ *   * from a plugin, a shared library loaded with load_plugin(). The library exports
+ *         extern "C" void daq_register_backends(DAQ_Backend_Registry &registry);
+ *     and registers its backends from there (see plugins/daq_counter_plugin.cpp). Site specific protocols can then be added without
+ *     recompiling the core. The host executable has to export its symbols (ENABLE_EXPORTS in CMake), so the plugin shares its
+ *     singletons (logger, registry) instead of getting its own copies
+ *
+ * Built-in backends use their DAQ_Protocol value. Plugin backends register with DAQ_Protocol::INVALID and get the next free id.
+ *
+ * Both lookups are flat and precomputed:
+ *   * by protocol, the id is the index into a table of constructors
+ *   * by name, a binary search in a sorted name table. Registering inserts at the right place (the duplicate check comes for free),
+ *     so there is no hashing or rebuilding at startup however many plugins are loaded
+ */
+
+class DAQ_Backend_Registry;
+
+using DAQ_Backend_Constructor = std::unique_ptr<DAQ_Backend> (*)();
+using DAQ_Register_Backends_Function = void (*)(DAQ_Backend_Registry &registry);
+
+constexpr const char *DAQ_PLUGIN_ENTRY_POINT = "daq_register_backends";
+
+class DAQ_Backend_Registry {
+
+public:
+    static DAQ_Backend_Registry &instance() {
+        static DAQ_Backend_Registry registry;
+        return registry;
+    }
+
+    // Returns the protocol the backend was registered under, or DAQ_Protocol::INVALID if the name or protocol is already taken
+    DAQ_Protocol register_backend(const std::string &name, DAQ_Protocol protocol, const DAQ_Backend_Constructor create) {
+
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        auto position = _lower_bound(name);
+        if (position != _by_name.end() && position->name == name) {
+            spdlog::warn("Backend {} is already registered", name);
+            return DAQ_Protocol::INVALID;
+        }
+
+        int id = static_cast<int>(protocol);
+        if (protocol == DAQ_Protocol::INVALID) {
+            id = static_cast<int>(_by_protocol.size());
+        } else if (id < static_cast<int>(_by_protocol.size()) && _by_protocol[id].create != nullptr) {
+            spdlog::warn("Protocol {} is already registered as {}", id, _by_protocol[id].name);
+            return DAQ_Protocol::INVALID;
+        }
+
+        if (id >= static_cast<int>(_by_protocol.size())) {
+            _by_protocol.resize(id + 1);
+        }
+        _by_protocol[id] = {name, create};
+        _by_name.insert(position, {name, static_cast<DAQ_Protocol>(id)});
+
+        return static_cast<DAQ_Protocol>(id);
+    }
+
+    std::unique_ptr<DAQ_Backend> create(const DAQ_Protocol protocol) const {
+        const int id = static_cast<int>(protocol);
+        if (id < 0 || id >= static_cast<int>(_by_protocol.size()) || _by_protocol[id].create == nullptr) {
+            return nullptr;
+        }
+        return _by_protocol[id].create();
+    }
+
+    // DAQ_Protocol::INVALID if no backend has that name
+    DAQ_Protocol protocol(std::string_view name) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto position = _lower_bound(name);
+        return position != _by_name.end() && position->name == name ? position->protocol : DAQ_Protocol::INVALID;
+    }
+
+    // Name the backend was registered under, empty if the protocol is unknown
+    std::string name(const DAQ_Protocol protocol) const {
+        const int id = static_cast<int>(protocol);
+        if (id < 0 || id >= static_cast<int>(_by_protocol.size())) {
+            return {};
+        }
+        return _by_protocol[id].name;
+    }
+
+    // Every registered name, sorted
+    std::vector<std::string> names() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<std::string> names;
+        names.reserve(_by_name.size());
+        for (const Name_Entry &entry : _by_name) {
+            names.push_back(entry.name);
+        }
+        return names;
+    }
+
+    // Loads a shared library and lets it register its backends. The library is never unloaded: the backends it creates point to its
+    // code (vtables) and may outlive any scope we could unload it from
+    bool load_plugin(const std::string &path) {
+
+        void *handle = ::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (handle == nullptr) {
+            spdlog::error("Fails to load plugin {}: {}", path, ::dlerror());
+            return false;
+        }
+
+        auto register_backends = reinterpret_cast<DAQ_Register_Backends_Function>(::dlsym(handle, DAQ_PLUGIN_ENTRY_POINT));
+        if (register_backends == nullptr) {
+            spdlog::error("Plugin {} does not export {}", path, DAQ_PLUGIN_ENTRY_POINT);
+            ::dlclose(handle);
+            return false;
+        }
+
+        const size_t backends_before = _registered_backends();
+        register_backends(*this);
+        spdlog::info("Plugin {} registered {} backends", path, _registered_backends() - backends_before);
+
+        return true;
+    }
+
+private:
+    DAQ_Backend_Registry() = default;
+
+    struct Protocol_Entry {
+        std::string name;
+        DAQ_Backend_Constructor create = nullptr;
+    };
+
+    struct Name_Entry {
+        std::string name;
+        DAQ_Protocol protocol;
+    };
+
+    // Called with _mutex held
+    std::vector<Name_Entry>::iterator _lower_bound(std::string_view name) {
+        return std::lower_bound(_by_name.begin(), _by_name.end(), name,
+                                [](const Name_Entry &entry, std::string_view value) { return entry.name < value; });
+    }
+
+    size_t _registered_backends() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _by_name.size();
+    }
+
+    // Registration only happens at startup (static initialisation, plugin loading), the mutex just keeps it safe if two threads
+    // happen to load plugins at the same time
+    std::mutex _mutex;
+    std::vector<Protocol_Entry> _by_protocol;
+    std::vector<Name_Entry> _by_name;
+};
+
+// Registers a backend at static initialisation, use it through DAQ_REGISTER_BACKEND. Type must be default constructible
+struct DAQ_Backend_Registrar {
+    DAQ_Backend_Registrar(const char *name, const DAQ_Protocol protocol, const DAQ_Backend_Constructor create) {
+        DAQ_Backend_Registry::instance().register_backend(name, protocol, create);
+    }
+};
+
+#define DAQ_REGISTER_BACKEND(name, protocol, Type)                                                     \
+    static const DAQ_Backend_Registrar daq_backend_registrar_##Type(                                   \
+        name, protocol, []() -> std::unique_ptr<DAQ_Backend> { return std::make_unique<Type>(); })
@@ -0,0 +1,413 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "daq_app.h"
+#include "daq_sample_store.h"
+#include "daq_static_manager.h"
+
+/*
+ * Benchmark of the DAQ pipeline: DAQ_App::update() followed by DAQ_App::get_latest_data(), fed by DAQ_Mode::SIMULATION backends
+ * generating UDP traffic as fast as they are allowed to: every update() fills what is free in the sample ring of each backend, and
+ * get_latest_data() empties it again.
+ *
+ * For every combination of backend count and payload size it measures:
+ *   * throughput            - messages generated, parsed and drained per second
+ *   * latency p50/p99/p999  - time from the start of the update() that generated a message until get_latest_data() returned its
+ *                             samples. Every message of a tick gets the latency of that tick, so this is an upper bound
+ *   * allocations / message - number of operator new calls during the measurement, divided by the number of messages
+ * A configuration that dropped samples is marked "valid":false (and the benchmark exits with 1): its numbers would be those of the
+ * ring overflowing, not of the pipeline.
+ *
+ * It then compares the two ways of dispatching update() to the backends (benchmark "backend_dispatch"), on the calling thread only:
+ *   * virtual - std::vector<std::unique_ptr<DAQ_Backend>>, the layout of DAQ_App::_daq_backend_manager
+ *   * static  - DAQ_Static_Manager, backends stored by value in a contiguous array of std::variant
+ * once with idle backends (so the dispatch itself dominates) and once with backends generating traffic at full speed.
+ *
+ * Finally it measures the reduction behind DAQ_Aggregator (benchmark "aggregate_reduce"), scalar against SIMD, over blocks the size
+ * of what get_latest_data() typically returns.
+ *
+ * And the scan of a single channel (benchmark "channel_scan"), in a DAQ_Sample_Store against the same rows stored as interleaved
+ * records, to show what the columnar layout buys.
+ *
+ * The output is one JSON object per line so it can be diffed or fed to a script between releases:
+ *   daq_bench [seconds per configuration, default 0.5]
+ */
+
+// Every allocation in the process goes through here, so we can check the hot path does not allocate. That includes the over-aligned
+// ones (the alignas(64) rings and pools), which C++17 routes through the align_val_t overloads. The array and nothrow forms of the
+// standard library end up in these as well
+static std::atomic<size_t> g_allocations{0};
+
+// Kept out of line, so the compiler does not pair the malloc it would see in operator new with the free in operator delete and warn
+// about a mismatched new/delete
+[[gnu::noinline]] static void *bench_allocate(size_t size, const size_t alignment) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) {
+        size = 1;
+    }
+    // aligned_alloc wants the size to be a multiple of the alignment
+    void *pointer = alignment <= alignof(std::max_align_t) ? std::malloc(size)
+                                                           : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+[[gnu::noinline]] static void bench_free(void *pointer) noexcept { std::free(pointer); }
+
+void *operator new(size_t size) { return bench_allocate(size, alignof(std::max_align_t)); }
+void *operator new(size_t size, std::align_val_t alignment) { return bench_allocate(size, static_cast<size_t>(alignment)); }
+
+void operator delete(void *pointer) noexcept { bench_free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { bench_free(pointer); }
+void operator delete(void *pointer, std::align_val_t) noexcept { bench_free(pointer); }
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept { bench_free(pointer); }
+
+struct Tick {
+    uint64_t duration_ns;
+    uint64_t messages;
+};
+
+// Percentile over messages, not over ticks: a tick that carried 1000 messages weighs 1000 times more than one that carried 1
+static uint64_t message_percentile(std::vector<Tick> &ticks, const uint64_t total_messages, const double percentile) {
+
+    std::sort(ticks.begin(), ticks.end(), [](const Tick &a, const Tick &b) { return a.duration_ns < b.duration_ns; });
+
+    const uint64_t target = static_cast<uint64_t>(percentile * static_cast<double>(total_messages));
+    uint64_t seen = 0;
+    for (const Tick &tick : ticks) {
+        seen += tick.messages;
+        if (seen > target) {
+            return tick.duration_ns;
+        }
+    }
+    return ticks.empty() ? 0 : ticks.back().duration_ns;
+}
+
+// Returns false if samples were dropped, the numbers would then measure the ring overflowing rather than the pipeline
+static bool run_configuration(const size_t backend_count, const size_t payload_size, const double seconds) {
+
+    std::vector<DAQ_Traffic_Config> traffic(backend_count);
+    for (size_t i = 0; i < backend_count; i++) {
+        traffic[i].messages_per_second = 0.0;
+        traffic[i].payload_size = payload_size;
+        traffic[i].seed = i + 1;
+    }
+
+    DAQ_App daq_app;
+    daq_app.init_simulation(traffic);
+
+    auto generated_messages = [&daq_app] {
+        uint64_t total = 0;
+        for (size_t i = 0; i < daq_app._backend_count(); i++) {
+            total += static_cast<const DAQ_Simulation &>(daq_app._backend(i)).generated_messages();
+        }
+        return total;
+    };
+
+    // Warm up so the first touches of the rings and buffers are not measured
+    for (size_t i = 0; i < 100; i++) {
+        daq_app.update();
+        daq_app.get_latest_data();
+    }
+
+    std::vector<Tick> ticks;
+    ticks.reserve(1 << 20);
+
+    const uint64_t messages_before = generated_messages();
+    const size_t allocations_before = g_allocations.load(std::memory_order_relaxed);
+    uint64_t samples = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::duration<double>(seconds);
+    auto now = start;
+    uint64_t messages_so_far = messages_before;
+
+    while (now < end && ticks.size() < ticks.capacity()) {
+        const auto tick_start = now;
+        daq_app.update();
+        samples += daq_app.get_latest_data().size();
+        now = std::chrono::steady_clock::now();
+
+        const uint64_t messages = generated_messages();
+        ticks.push_back({static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - tick_start).count()),
+                         messages - messages_so_far});
+        messages_so_far = messages;
+    }
+
+    const size_t allocations = g_allocations.load(std::memory_order_relaxed) - allocations_before;
+    const uint64_t messages = messages_so_far - messages_before;
+    const double elapsed = std::chrono::duration<double>(now - start).count();
+
+    size_t dropped_samples = 0;
+    for (size_t i = 0; i < daq_app._backend_count(); i++) {
+        dropped_samples += daq_app._backend(i).dropped_samples();
+    }
+
+    // Reports the backends that actually ran: without ALLOW_MULTIPLE_BACKENDS only the first traffic configuration gets one
+    std::printf("{\"benchmark\":\"daq_pipeline\",\"backends\":%zu,\"payload_bytes\":%zu,\"seconds\":%.3f,"
+                "\"messages\":%llu,\"messages_per_second\":%.0f,\"samples\":%llu,\"dropped_samples\":%zu,"
+                "\"latency_ns_p50\":%llu,\"latency_ns_p99\":%llu,\"latency_ns_p999\":%llu,"
+                "\"allocations_per_message\":%.6f,\"valid\":%s}\n",
+                daq_app._backend_count(), payload_size, elapsed,
+                static_cast<unsigned long long>(messages), static_cast<double>(messages) / elapsed,
+                static_cast<unsigned long long>(samples), dropped_samples,
+                static_cast<unsigned long long>(message_percentile(ticks, messages, 0.50)),
+                static_cast<unsigned long long>(message_percentile(ticks, messages, 0.99)),
+                static_cast<unsigned long long>(message_percentile(ticks, messages, 0.999)),
+                messages > 0 ? static_cast<double>(allocations) / static_cast<double>(messages) : 0.0,
+                dropped_samples == 0 ? "true" : "false");
+    std::fflush(stdout);
+
+    daq_app.shutdown();
+    return dropped_samples == 0;
+}
+
+// Everything the dispatch benchmark needs from a backend set, so both paths run the exact same loop
+struct Virtual_Backends {
+    std::vector<std::unique_ptr<DAQ_Backend>> backends;
+    std::vector<float> latest_data;
+
+    void update() {
+        for (size_t i = 0; i < backends.size(); i++) {
+            daq_backend_update(*backends[i]);
+        }
+    }
+
+    size_t drain() {
+        latest_data.clear();
+        for (size_t i = 0; i < backends.size(); i++) {
+            backends[i]->samples().drain([this](const float sample) { latest_data.push_back(sample); });
+        }
+        return latest_data.size();
+    }
+};
+
+struct Static_Backends {
+    using Manager = DAQ_Static_Manager<DAQ_UDP, DAQ_Mavlink, DAQ_Playback, DAQ_Simulation>;
+
+    explicit Static_Backends(const size_t backend_count) : manager(backend_count) {};
+
+    void update() { manager.update(); }
+    size_t drain() { return manager.get_latest_data().size(); }
+
+    Manager manager;
+};
+
+template <typename Backend_Set>
+static void run_dispatch(const char *mode, Backend_Set &backend_set, const char *workload, const size_t backend_count,
+                         const double seconds) {
+
+    for (size_t i = 0; i < 100; i++) {
+        backend_set.update();
+        backend_set.drain();
+    }
+
+    uint64_t ticks = 0;
+    uint64_t samples = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::duration<double>(seconds);
+    auto now = start;
+
+    while (now < end) {
+        // Checking the clock every tick would cost as much as an idle tick, so check it every 64 ticks
+        for (size_t i = 0; i < 64; i++) {
+            backend_set.update();
+            samples += backend_set.drain();
+        }
+        ticks += 64;
+        now = std::chrono::steady_clock::now();
+    }
+
+    const double elapsed = std::chrono::duration<double>(now - start).count();
+
+    std::printf("{\"benchmark\":\"backend_dispatch\",\"mode\":\"%s\",\"workload\":\"%s\",\"backends\":%zu,"
+                "\"ticks\":%llu,\"ns_per_tick\":%.1f,\"ns_per_backend_update\":%.1f,\"samples_per_second\":%.0f}\n",
+                mode, workload, backend_count, static_cast<unsigned long long>(ticks),
+                elapsed * 1e9 / static_cast<double>(ticks),
+                elapsed * 1e9 / static_cast<double>(ticks * backend_count),
+                static_cast<double>(samples) / elapsed);
+    std::fflush(stdout);
+}
+
+static void run_dispatch_comparison(const size_t backend_count, const bool idle, const double seconds) {
+
+    DAQ_Traffic_Config config;
+    // Idle backends are rate limited so far down that update() only refills the token bucket
+    config.messages_per_second = idle ? 1e-3 : 0.0;
+    config.payload_size = 64;
+    const char *workload = idle ? "idle" : "full_speed";
+
+    {
+        Virtual_Backends virtual_backends;
+        for (size_t i = 0; i < backend_count; i++) {
+            config.seed = i + 1;
+            virtual_backends.backends.push_back(std::make_unique<DAQ_Simulation>(config));
+            virtual_backends.backends.back()->init();
+        }
+        virtual_backends.latest_data.reserve(backend_count * DAQ_Backend::Sample_Ring::capacity());
+
+        run_dispatch("virtual", virtual_backends, workload, backend_count, seconds);
+    }
+
+    {
+        Static_Backends static_backends(backend_count);
+        for (size_t i = 0; i < backend_count; i++) {
+            config.seed = i + 1;
+            static_backends.manager.emplace<DAQ_Simulation>(config);
+        }
+        static_backends.manager.init();
+
+        run_dispatch("static", static_backends, workload, backend_count, seconds);
+    }
+}
+
+// Makes the compiler believe value is used, so the computation producing it can not be dropped, without storing it anywhere
+template <typename T>
+static void do_not_optimize(const T &value) {
+    asm volatile("" : : "g"(value) : "memory");
+}
+
+template <typename Reduce>
+static void run_reduce(const char *mode, Reduce reduce, const std::vector<float> &samples, const double seconds) {
+
+    uint64_t calls = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::duration<double>(seconds);
+    auto now = start;
+
+    while (now < end) {
+        for (size_t i = 0; i < 64; i++) {
+            const DAQ_Aggregate aggregate = reduce(std::span<const float>(samples));
+            do_not_optimize(aggregate);
+        }
+        calls += 64;
+        now = std::chrono::steady_clock::now();
+    }
+
+    const double elapsed = std::chrono::duration<double>(now - start).count();
+
+    std::printf("{\"benchmark\":\"aggregate_reduce\",\"mode\":\"%s\",\"samples\":%zu,\"ns_per_block\":%.1f,"
+                "\"samples_per_second\":%.0f}\n",
+                mode, samples.size(), elapsed * 1e9 / static_cast<double>(calls),
+                static_cast<double>(calls * samples.size()) / elapsed);
+    std::fflush(stdout);
+}
+
+static void run_reduce_comparison(const size_t sample_count, const double seconds) {
+
+    std::vector<float> samples(sample_count);
+    for (size_t i = 0; i < sample_count; i++) {
+        samples[i] = static_cast<float>(i % 1000) * 0.25f;
+    }
+
+    run_reduce("scalar", daq_reduce_scalar, samples, seconds);
+    run_reduce("simd", daq_reduce, samples, seconds);
+}
+
+// Row layout the sample store is compared against
+struct Interleaved_Row {
+    uint64_t timestamp_ns;
+    float values[8];
+};
+
+template <typename Scan>
+static void run_scan(const char *layout, Scan scan, const size_t rows, const double seconds) {
+
+    uint64_t scans = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::duration<double>(seconds);
+    auto now = start;
+
+    while (now < end) {
+        do_not_optimize(scan());
+        scans++;
+        now = std::chrono::steady_clock::now();
+    }
+
+    const double elapsed = std::chrono::duration<double>(now - start).count();
+
+    std::printf("{\"benchmark\":\"channel_scan\",\"layout\":\"%s\",\"rows\":%zu,\"channels\":8,\"ns_per_scan\":%.0f,"
+                "\"rows_per_second\":%.0f}\n",
+                layout, rows, elapsed * 1e9 / static_cast<double>(scans), static_cast<double>(scans * rows) / elapsed);
+    std::fflush(stdout);
+}
+
+static void run_scan_comparison(const size_t rows, const double seconds) {
+
+    constexpr size_t CHANNELS = 8;
+    constexpr size_t CHANNEL = 3;
+
+    DAQ_Sample_Store store(CHANNELS, DAQ_Sample_Store::DEFAULT_ROWS_PER_CHUNK,
+                           (rows + DAQ_Sample_Store::DEFAULT_ROWS_PER_CHUNK - 1) / DAQ_Sample_Store::DEFAULT_ROWS_PER_CHUNK);
+    std::vector<Interleaved_Row> interleaved(rows);
+
+    for (size_t i = 0; i < rows; i++) {
+        Interleaved_Row &row = interleaved[i];
+        row.timestamp_ns = i * 1000;
+        for (size_t channel = 0; channel < CHANNELS; channel++) {
+            row.values[channel] = static_cast<float>((i + channel) % 1000) * 0.25f;
+        }
+        store.append(row.timestamp_ns, row.values);
+    }
+
+    run_scan("interleaved", [&interleaved] {
+        DAQ_Aggregate aggregate;
+        for (const Interleaved_Row &row : interleaved) {
+            aggregate.min = std::min(aggregate.min, row.values[CHANNEL]);
+            aggregate.max = std::max(aggregate.max, row.values[CHANNEL]);
+            aggregate.sum += row.values[CHANNEL];
+        }
+        aggregate.count = interleaved.size();
+        return aggregate;
+    }, rows, seconds);
+
+    run_scan("columnar", [&store, rows] { return store.aggregate(CHANNEL, 0, rows); }, rows, seconds);
+}
+
+int main(int argc, char **argv) {
+
+    const double seconds = argc > 1 ? std::atof(argv[1]) : 0.5;
+
+    // The backends log from update(), which would only measure how fast the terminal is
+    spdlog::set_level(spdlog::level::warn);
+
+    bool valid = true;
+    for (const size_t backend_count : {1, 2, 4, 8}) {
+        for (const size_t payload_size : {16, 64, 256, 1024}) {
+            valid = run_configuration(backend_count, payload_size, seconds) && valid;
+        }
+    }
+
+    for (const bool idle : {true, false}) {
+        for (const size_t backend_count : {1, 8, 64}) {
+            run_dispatch_comparison(backend_count, idle, seconds);
+        }
+    }
+
+    for (const size_t sample_count : {64, 1024, 8192}) {
+        run_reduce_comparison(sample_count, seconds);
+    }
+
+    for (const size_t rows : {size_t(1) << 14, size_t(1) << 20}) {
+        run_scan_comparison(rows, seconds);
+    }
+
+    if (!valid) {
+        std::fprintf(stderr, "daq_bench: samples were dropped, the daq_pipeline results marked \"valid\":false are not comparable\n");
+        return 1;
+    }
+    return 0;
+}
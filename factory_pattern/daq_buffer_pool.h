@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+/*
+ * Pool of fixed size message buffers.
+ *
+ * Parsing and sending messages tends to need a buffer per message, and going to malloc()/free() for each of them is both slow and
+ * unpredictable (the allocator takes locks, and may call into the kernel). The pool carves buffers out of large slabs instead and
+ * recycles them forever, so once it has grown to the working set of the application, acquiring and releasing never allocates.
+ *
+ * Every pool has a single owner: the thread (or, for a backend, whichever worker is currently running its update()) that acquires
+ * buffers from it. The owner keeps its free buffers in a plain linked list, no atomics at all. Buffers very often end up being
+ * released by another thread though (e.g. the application queues a message, the backend sends it and gives the buffer back). Those
+ * go onto a lock-free return stack, and the owner takes the whole stack in one exchange the next time its own list runs dry:
+ *
+ *   owner:  acquire() <--- local free list <--- (empty? take everything) <--- return stack <--- release() from any thread
+ *           release_local() --->
+ *
+ * Since the return stack is only ever emptied as a whole, there is no ABA problem to worry about.
+ *
+ * Every buffer is preceded by a small header pointing back to its pool, so a buffer can be released without knowing where it came
+ * from (DAQ_Buffer_Pool::owner_of()). Buffers are cache line aligned so two threads working on neighbouring buffers never share a line.
+ */
+class DAQ_Buffer_Pool {
+
+public:
+    static constexpr size_t DEFAULT_BUFFERS_PER_SLAB = 64;
+    static constexpr size_t ALIGNMENT = 64;
+
+    // Nothing is allocated until the first acquire() (or reserve()), so an unused pool costs nothing
+    explicit DAQ_Buffer_Pool(const size_t buffer_size, const size_t buffers_per_slab = DEFAULT_BUFFERS_PER_SLAB,
+                             const size_t max_slabs = 0) :
+        _buffer_size(buffer_size),
+        // One cache line for the header, then the data rounded up to whole cache lines
+        _block_size(ALIGNMENT + (buffer_size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT),
+        _buffers_per_slab(buffers_per_slab > 0 ? buffers_per_slab : 1),
+        _max_slabs(max_slabs) {};
+
+    // Every buffer has to be back in the pool (or at least never touched again) by the time the pool is destroyed
+    ~DAQ_Buffer_Pool() {
+        for (void *slab : _slabs) {
+            std::free(slab);
+        }
+    }
+
+    DAQ_Buffer_Pool(const DAQ_Buffer_Pool &) = delete;
+    DAQ_Buffer_Pool &operator=(const DAQ_Buffer_Pool &) = delete;
+
+    // Owner only. Returns nullptr if the pool is empty and has reached max_slabs
+    uint8_t *acquire() {
+
+        if (_local == nullptr) {
+            _local = _remote.exchange(nullptr, std::memory_order_acquire);
+        }
+        if (_local == nullptr && !_grow()) {
+            return nullptr;
+        }
+
+        Header *header = _local;
+        _local = header->next;
+        return _data(header);
+    }
+
+    // Owner only, cheaper than release()
+    void release_local(uint8_t *buffer) {
+        Header *header = _header(buffer);
+        header->next = _local;
+        _local = header;
+    }
+
+    // Any thread
+    void release(uint8_t *buffer) {
+        Header *header = _header(buffer);
+        header->next = _remote.load(std::memory_order_relaxed);
+        while (!_remote.compare_exchange_weak(header->next, header, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+    // Owner only. Grows the pool up front to hold at least buffers, so the hot path never has to
+    void reserve(const size_t buffers) {
+        while (_slabs.size() * _buffers_per_slab < buffers && _grow()) {}
+    }
+
+    static DAQ_Buffer_Pool &owner_of(const uint8_t *buffer) { return *_header(const_cast<uint8_t *>(buffer))->pool; }
+
+    size_t buffer_size() const { return _buffer_size; }
+    // Number of times the pool had to go to the allocator. Stays constant in steady state
+    size_t slabs() const { return _slabs.size(); }
+
+private:
+    struct Header {
+        Header *next;
+        DAQ_Buffer_Pool *pool;
+    };
+
+    static_assert(sizeof(Header) <= ALIGNMENT, "The buffer header must fit in front of the cache line the data starts at");
+
+    // The data starts on the cache line following the header
+    static uint8_t *_data(Header *header) { return reinterpret_cast<uint8_t *>(header) + ALIGNMENT; }
+    static Header *_header(uint8_t *buffer) { return reinterpret_cast<Header *>(buffer - ALIGNMENT); }
+
+    bool _grow() {
+
+        if (_max_slabs != 0 && _slabs.size() >= _max_slabs) {
+            return false;
+        }
+
+        void *slab = std::aligned_alloc(ALIGNMENT, _block_size * _buffers_per_slab);
+        if (slab == nullptr) {
+            return false;
+        }
+        _slabs.push_back(slab);
+
+        uint8_t *bytes = static_cast<uint8_t *>(slab);
+        for (size_t i = 0; i < _buffers_per_slab; i++) {
+            Header *header = reinterpret_cast<Header *>(bytes + i * _block_size);
+            header->pool = this;
+            header->next = _local;
+            _local = header;
+        }
+        return true;
+    }
+
+    const size_t _buffer_size;
+    const size_t _block_size;
+    const size_t _buffers_per_slab;
+    const size_t _max_slabs;
+
+    // Owner side
+    Header *_local = nullptr;
+    std::vector<void *> _slabs;
+
+    // Written by every releasing thread, kept away from the owner's fields
+    alignas(ALIGNMENT) std::atomic<Header *> _remote {nullptr};
+};
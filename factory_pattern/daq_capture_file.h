@@ -0,0 +1,186 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+/*
+ * Capture file format shared by the recorder and the playback backend.
+ *
+ *   | file header (16 bytes) | record header (16 bytes) | payload | record header | payload | ...
+ *
+ * Every record holds the raw bytes one backend received (a UDP datagram, a chunk of the MAVLink byte stream, ...) together with the
+ * time it was received and the protocol it came from, so replaying it goes through exactly the same parsing code as live data.
+ *
+ * A record flagged DAQ_CAPTURE_RECORD_PADDING carries no data. Writers that need to keep their writes aligned (e.g. O_DIRECT) use it to
+ * fill the end of a block, readers just skip it.
+ *
+ * Timestamps come from the monotonic clock, only their differences within one file mean anything.
+ *
+ * All fields are stored little endian. The headers are copied as they are in memory, which is only that on little endian hosts (the
+ * static_assert below keeps it from silently writing something else on the others).
+ */
+
+constexpr char DAQ_CAPTURE_MAGIC[8] = {'D', 'A', 'Q', 'C', 'A', 'P', 'T', '1'};
+constexpr uint32_t DAQ_CAPTURE_VERSION = 1;
+constexpr uint16_t DAQ_CAPTURE_RECORD_PADDING = 0x0001;
+
+struct DAQ_Capture_File_Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct DAQ_Capture_Record_Header {
+    uint64_t timestamp_ns;
+    uint32_t length;
+    uint16_t protocol;
+    uint16_t flags;
+};
+
+static_assert(std::endian::native == std::endian::little, "Capture headers are memcpy'ed and have to be little endian");
+static_assert(sizeof(DAQ_Capture_File_Header) == 16, "Capture file header must stay 16 bytes");
+static_assert(sizeof(DAQ_Capture_Record_Header) == 16, "Capture record header must stay 16 bytes");
+
+struct DAQ_Capture_Record {
+    uint64_t timestamp_ns;
+    uint16_t protocol;
+    // Points straight into the mapped file
+    std::span<const uint8_t> payload;
+};
+
+/*
+ * Read only view of a capture file.
+ *
+ * The whole file is mmap'ed instead of being read through a stream, so the kernel pages it in on demand and replaying a multi
+ * gigabyte capture does not copy it through a user space buffer. Records are variable length, so finding record N means walking
+ * the N - 1 records before it. Instead of walking the whole file on open, the offsets are indexed lazily: only as far as the
+ * furthest record anyone asked for, and each record is only ever walked once.
+ */
+class DAQ_Capture_Reader {
+
+public:
+    DAQ_Capture_Reader() = default;
+    ~DAQ_Capture_Reader() { close(); }
+
+    DAQ_Capture_Reader(const DAQ_Capture_Reader &) = delete;
+    DAQ_Capture_Reader &operator=(const DAQ_Capture_Reader &) = delete;
+
+    bool open(const std::string &path) {
+
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            spdlog::error("Fails to open capture {}: {}", path, std::strerror(errno));
+            return false;
+        }
+
+        struct stat file_stat {};
+        if (::fstat(fd, &file_stat) < 0 || static_cast<size_t>(file_stat.st_size) < sizeof(DAQ_Capture_File_Header)) {
+            spdlog::error("Capture {} is too small to be valid", path);
+            ::close(fd);
+            return false;
+        }
+
+        _size = static_cast<size_t>(file_stat.st_size);
+        void *mapping = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // The mapping keeps its own reference to the file
+        ::close(fd);
+
+        if (mapping == MAP_FAILED) {
+            spdlog::error("Fails to mmap capture {}: {}", path, std::strerror(errno));
+            _size = 0;
+            return false;
+        }
+
+        _data = static_cast<const uint8_t *>(mapping);
+        // Playback goes through the file front to back, let the kernel read ahead aggressively
+        ::madvise(mapping, _size, MADV_SEQUENTIAL);
+
+        DAQ_Capture_File_Header header;
+        std::memcpy(&header, _data, sizeof(header));
+        if (std::memcmp(header.magic, DAQ_CAPTURE_MAGIC, sizeof(DAQ_CAPTURE_MAGIC)) != 0 || header.version != DAQ_CAPTURE_VERSION) {
+            spdlog::error("{} is not a version {} capture file", path, DAQ_CAPTURE_VERSION);
+            close();
+            return false;
+        }
+
+        _offsets.clear();
+        _scan_offset = sizeof(DAQ_Capture_File_Header);
+        return true;
+    }
+
+    void close() {
+        if (_data != nullptr) {
+            ::munmap(const_cast<uint8_t *>(_data), _size);
+            _data = nullptr;
+            _size = 0;
+        }
+    }
+
+    // Fetches record number index (padding is not counted). Returns false once index is past the end of the capture
+    bool record(const size_t index, DAQ_Capture_Record &record) {
+
+        while (index >= _offsets.size()) {
+            if (!_index_next()) {
+                return false;
+            }
+        }
+
+        DAQ_Capture_Record_Header header;
+        std::memcpy(&header, _data + _offsets[index], sizeof(header));
+
+        record.timestamp_ns = header.timestamp_ns;
+        record.protocol = header.protocol;
+        record.payload = std::span<const uint8_t>(_data + _offsets[index] + sizeof(header), header.length);
+        return true;
+    }
+
+    size_t indexed_records() const { return _offsets.size(); }
+    size_t size_bytes() const { return _size; }
+
+private:
+
+    // Walks one more record and remembers its offset. Returns false at the end of the file (or at a truncated record)
+    bool _index_next() {
+
+        while (_scan_offset + sizeof(DAQ_Capture_Record_Header) <= _size) {
+            DAQ_Capture_Record_Header header;
+            std::memcpy(&header, _data + _scan_offset, sizeof(header));
+
+            const size_t record_offset = _scan_offset;
+            const size_t record_end = _scan_offset + sizeof(header) + header.length;
+            if (record_end > _size) {
+                // The recorder was most likely killed half way through a write
+                spdlog::warn("Capture truncated at byte {}", record_offset);
+                _scan_offset = _size;
+                return false;
+            }
+
+            _scan_offset = record_end;
+
+            if ((header.flags & DAQ_CAPTURE_RECORD_PADDING) == 0) {
+                _offsets.push_back(record_offset);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    const uint8_t *_data = nullptr;
+    size_t _size = 0;
+
+    std::vector<size_t> _offsets;
+    size_t _scan_offset = 0;
+};
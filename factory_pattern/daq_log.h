@@ -0,0 +1,285 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "daq_ring_buffer.h"
+
+/*
+ * Deferred logging for the acquisition hot path.
+ *
+ * spdlog::info() formats the message on the calling thread, which costs far more than anything update() does with a packet. The
+ * DAQ_LOG_* macros below do not format anything. A log call only copies:
+ *   * a pointer to a static "log site" (level + format string), created once per call site at compile time
+ *   * a pointer to the function that knows how to decode the arguments of that call site
+ *   * a timestamp and the raw bytes of the arguments
+ * into a ring buffer owned by the calling thread (so there is no contention between threads either). A background thread drains the
+ * rings of every thread, decodes the arguments, formats the message and hands it to spdlog with the original timestamp. When a
+ * thread exits, its ring is retired: the background thread drains it one last time and frees it, so short lived threads (e.g. the
+ * ones of DAQ_App::init() and shutdown()) do not leave rings behind.
+ *
+ * Two rules come with it:
+ *   * the arguments have to be trivially copyable and fit in DAQ_LOG_MAX_ARG_BYTES. A const char * is fine only if it points to
+ *     something that outlives the log call, like a string literal (e.g. protocol_type()). Use spdlog directly for std::string
+ *   * deferred messages can show up after messages logged directly through spdlog at roughly the same time
+ *
+ * The format string is still checked against the arguments at compile time, like spdlog does, even though it is only used later.
+ *
+ * Levels below DAQ_LOG_ACTIVE_LEVEL are removed at compile time, the call site costs nothing at all. Levels above it are still
+ * filtered at run time with the spdlog level, before anything is copied.
+ */
+
+#define DAQ_LOG_LEVEL_TRACE 0
+#define DAQ_LOG_LEVEL_DEBUG 1
+#define DAQ_LOG_LEVEL_INFO 2
+#define DAQ_LOG_LEVEL_WARN 3
+#define DAQ_LOG_LEVEL_ERROR 4
+#define DAQ_LOG_LEVEL_OFF 5
+
+#ifndef DAQ_LOG_ACTIVE_LEVEL
+#define DAQ_LOG_ACTIVE_LEVEL DAQ_LOG_LEVEL_INFO
+#endif
+
+constexpr size_t DAQ_LOG_MAX_ARG_BYTES = 40;
+constexpr size_t DAQ_LOG_RING_CAPACITY = 1024;
+
+struct DAQ_Log_Site {
+    spdlog::level::level_enum level;
+    const char *format;
+};
+
+struct DAQ_Log_Record {
+    const DAQ_Log_Site *site;
+    void (*decode)(const DAQ_Log_Record &record, fmt::memory_buffer &buffer);
+    int64_t timestamp_ns;
+    alignas(8) uint8_t args[DAQ_LOG_MAX_ARG_BYTES];
+};
+
+static_assert(sizeof(DAQ_Log_Record) == 64, "A log record should fit in a single cache line");
+
+// Generated once per call site, knows the types of the arguments that were copied into the record
+template <typename... Args>
+void daq_log_decode(const DAQ_Log_Record &record, fmt::memory_buffer &buffer) {
+
+    std::tuple<Args...> values;
+    size_t offset = 0;
+    std::apply([&](auto &...value) { ((std::memcpy(&value, record.args + offset, sizeof(value)), offset += sizeof(value)), ...); },
+               values);
+    std::apply([&](auto &...value) { fmt::format_to(std::back_inserter(buffer), fmt::runtime(record.site->format), value...); },
+               values);
+}
+
+class DAQ_Logger {
+
+public:
+    using Ring = DAQ_Ring_Buffer<DAQ_Log_Record, DAQ_LOG_RING_CAPACITY>;
+
+    static DAQ_Logger &instance() {
+        static DAQ_Logger logger;
+        return logger;
+    }
+
+    // Ring of the calling thread, created the first time a thread logs and retired when the thread exits
+    Ring &thread_ring() {
+        thread_local Thread_Handle handle;
+        if (handle.ring == nullptr) {
+            handle.ring = _register_thread();
+        }
+        return handle.ring->ring;
+    }
+
+    void record_dropped() { _dropped.fetch_add(1, std::memory_order_relaxed); }
+    size_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+    // Blocks until everything logged so far by any thread has been written out. Rings being empty is not enough, the consumer may
+    // still be writing what it took out of them: wait for a whole pass of the consumer that started after this call
+    void flush() {
+        {
+            std::unique_lock<std::mutex> lock(_passes_mutex);
+            const uint64_t target = _passes + 2;
+            _passes_cv.wait(lock, [&] { return _passes >= target; });
+        }
+        _logger->flush();
+    }
+
+private:
+
+    struct Thread_Ring {
+        Ring ring;
+        // Set when the owning thread exits, nothing is pushed into the ring after that
+        std::atomic<bool> retired {false};
+    };
+
+    struct Thread_Handle {
+        Thread_Ring *ring = nullptr;
+        ~Thread_Handle() {
+            if (ring != nullptr) {
+                ring->retired.store(true, std::memory_order_release);
+                ring = nullptr;
+            }
+        }
+    };
+
+    DAQ_Logger() {
+        // Touching spdlog first guarantees its registry is destroyed after us, so the last messages can still be written on exit
+        _logger = spdlog::default_logger();
+        _consumer = std::thread(&DAQ_Logger::_consumer_loop, this);
+    }
+
+    ~DAQ_Logger() {
+        _stopping.store(true, std::memory_order_release);
+        if (_consumer.joinable()) {
+            _consumer.join();
+        }
+        if (dropped() > 0) {
+            _logger->warn("{} log records were dropped because the log rings were full", dropped());
+        }
+    }
+
+    Thread_Ring *_register_thread() {
+        // Owned by the logger, only the consumer frees a ring, once its thread has exited and it has been drained
+        std::lock_guard<std::mutex> lock(_rings_mutex);
+        _rings.push_back(std::make_unique<Thread_Ring>());
+        return _rings.back().get();
+    }
+
+    void _consumer_loop() {
+
+        fmt::memory_buffer buffer;
+        std::vector<DAQ_Log_Record> batch;
+
+        while (true) {
+            // Read the flag before draining, so that everything pushed before the logger was destroyed gets a last drain
+            const bool stopping = _stopping.load(std::memory_order_acquire);
+
+            batch.clear();
+            {
+                std::lock_guard<std::mutex> lock(_rings_mutex);
+                for (auto &thread_ring : _rings) {
+                    // Read before draining: once retired, this drain is guaranteed to see the last record of the thread
+                    const bool retired = thread_ring->retired.load(std::memory_order_acquire);
+                    thread_ring->ring.drain([&](const DAQ_Log_Record &record) { batch.push_back(record); });
+                    if (retired) {
+                        thread_ring.reset();
+                    }
+                }
+                _rings.erase(std::remove(_rings.begin(), _rings.end(), nullptr), _rings.end());
+            }
+
+            // Each ring is in order, but the rings of different threads have to be merged back into a single time line
+            std::stable_sort(batch.begin(), batch.end(), [](const DAQ_Log_Record &a, const DAQ_Log_Record &b) {
+                return a.timestamp_ns < b.timestamp_ns;
+            });
+            for (const DAQ_Log_Record &record : batch) {
+                _write(record, buffer);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_passes_mutex);
+                // Nothing will be written after the last pass, so whoever still waits in flush() has nothing left to wait for
+                _passes = stopping ? UINT64_MAX : _passes + 1;
+            }
+            _passes_cv.notify_all();
+
+            if (stopping) {
+                break;
+            }
+            if (batch.empty()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        _logger->flush();
+    }
+
+    void _write(const DAQ_Log_Record &record, fmt::memory_buffer &buffer) {
+        buffer.clear();
+        // The format was checked at compile time, but an exception escaping this thread would terminate the whole DAQ over a log
+        // line, so anything that still goes wrong is logged as is
+        try {
+            record.decode(record, buffer);
+        } catch (const fmt::format_error &error) {
+            buffer.clear();
+            fmt::format_to(std::back_inserter(buffer), "Invalid log format \"{}\": {}", record.site->format, error.what());
+        }
+
+        const auto timestamp = spdlog::log_clock::time_point(
+            std::chrono::duration_cast<spdlog::log_clock::duration>(std::chrono::nanoseconds(record.timestamp_ns)));
+        _logger->log(timestamp, spdlog::source_loc {}, record.site->level, spdlog::string_view_t(buffer.data(), buffer.size()));
+    }
+
+    std::shared_ptr<spdlog::logger> _logger;
+
+    std::mutex _rings_mutex;
+    std::vector<std::unique_ptr<Thread_Ring>> _rings;
+
+    // Passes of the consumer over the rings, for flush()
+    std::mutex _passes_mutex;
+    std::condition_variable _passes_cv;
+    uint64_t _passes = 0;
+
+    std::atomic<bool> _stopping{false};
+    std::atomic<size_t> _dropped{0};
+    std::thread _consumer;
+};
+
+// format is the one of the site, taken again here only so fmt checks it against the argument types at compile time
+template <typename... Args>
+void daq_log_write(const DAQ_Log_Site &site, [[maybe_unused]] fmt::format_string<std::decay_t<const Args>...> format,
+                   const Args &...args) {
+
+    static_assert((std::is_trivially_copyable_v<std::decay_t<const Args>> && ...),
+                  "DAQ_LOG arguments must be trivially copyable, use spdlog directly for std::string and friends");
+    static_assert((sizeof(std::decay_t<const Args>) + ... + 0) <= DAQ_LOG_MAX_ARG_BYTES, "Too many DAQ_LOG arguments");
+
+    if (!spdlog::should_log(site.level)) {
+        return;
+    }
+
+    DAQ_Log_Record record;
+    record.site = &site;
+    record.decode = &daq_log_decode<std::decay_t<const Args>...>;
+    record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        spdlog::log_clock::now().time_since_epoch()).count();
+
+    size_t offset = 0;
+    // Unused by calls without arguments
+    [[maybe_unused]] auto copy_argument = [&](const auto &value) {
+        std::memcpy(record.args + offset, &value, sizeof(value));
+        offset += sizeof(value);
+    };
+    // Arrays (string literals) decay to pointers, so only the pointer is copied
+    (copy_argument(static_cast<std::decay_t<const Args>>(args)), ...);
+
+    DAQ_Logger &logger = DAQ_Logger::instance();
+    if (!logger.thread_ring().try_push(record)) {
+        logger.record_dropped();
+    }
+}
+
+#define DAQ_LOG_AT(level_value, spdlog_level, format, ...)                                      \
+    do {                                                                                        \
+        if constexpr ((level_value) >= DAQ_LOG_ACTIVE_LEVEL) {                                  \
+            static constexpr DAQ_Log_Site daq_log_site {spdlog_level, format};                  \
+            daq_log_write(daq_log_site, format __VA_OPT__(,) __VA_ARGS__);                      \
+        }                                                                                       \
+    } while (0)
+
+#define DAQ_LOG_TRACE(format, ...) DAQ_LOG_AT(DAQ_LOG_LEVEL_TRACE, spdlog::level::trace, format __VA_OPT__(,) __VA_ARGS__)
+#define DAQ_LOG_DEBUG(format, ...) DAQ_LOG_AT(DAQ_LOG_LEVEL_DEBUG, spdlog::level::debug, format __VA_OPT__(,) __VA_ARGS__)
+#define DAQ_LOG_INFO(format, ...) DAQ_LOG_AT(DAQ_LOG_LEVEL_INFO, spdlog::level::info, format __VA_OPT__(,) __VA_ARGS__)
+#define DAQ_LOG_WARN(format, ...) DAQ_LOG_AT(DAQ_LOG_LEVEL_WARN, spdlog::level::warn, format __VA_OPT__(,) __VA_ARGS__)
+#define DAQ_LOG_ERROR(format, ...) DAQ_LOG_AT(DAQ_LOG_LEVEL_ERROR, spdlog::level::err, format __VA_OPT__(,) __VA_ARGS__)
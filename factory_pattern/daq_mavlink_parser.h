@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+/*
+ * Streaming MAVLink v2 framer.
+ *
+ * MAVLink v2 frame layout (all multi byte fields are little endian):
+ *
+ *   | STX (0xFD) | len | incompat | compat | seq | sysid | compid | msgid (3 bytes) | payload (len) | crc (2) | signature (13, optional) |
+ *
+ * The checksum is CRC-16/MCRF4XX over everything after STX up to the end of the payload, followed by one extra "CRC_EXTRA" byte
+ * that depends on the message id (it is a hash of the message definition, so both ends agree on the payload layout).
+ *
+ * The parser never allocates:
+ *   * frames that sit entirely inside the buffer given to parse() are validated and handed to the callback in place
+ *   * a frame that is split across two reads is copied into a fixed size carry buffer (at most one frame long), completed with the
+ *     bytes of the next read and handed over from there
+ *
+ * Either way, the payload view given to the callback is only valid during the callback.
+ */
+
+constexpr uint8_t MAVLINK_STX_V2 = 0xFD;
+constexpr size_t MAVLINK_HEADER_LEN = 10;
+constexpr size_t MAVLINK_CHECKSUM_LEN = 2;
+constexpr size_t MAVLINK_SIGNATURE_LEN = 13;
+constexpr size_t MAVLINK_MAX_PAYLOAD_LEN = 255;
+constexpr size_t MAVLINK_MAX_FRAME_LEN = MAVLINK_HEADER_LEN + MAVLINK_MAX_PAYLOAD_LEN + MAVLINK_CHECKSUM_LEN + MAVLINK_SIGNATURE_LEN;
+
+constexpr uint8_t MAVLINK_INCOMPAT_FLAG_SIGNED = 0x01;
+
+constexpr uint32_t MAVLINK_MSG_ID_HEARTBEAT = 0;
+constexpr uint32_t MAVLINK_MSG_ID_ATTITUDE = 30;
+
+// CRC-16/MCRF4XX (reflected polynomial 0x8408, initial value 0xFFFF). The table is generated at compile time, so each byte costs
+// one lookup instead of the eight shift/xor steps of the bitwise version.
+constexpr std::array<uint16_t, 256> mavlink_make_crc_table() {
+    std::array<uint16_t, 256> table {};
+    for (uint16_t byte = 0; byte < 256; byte++) {
+        uint16_t crc = byte;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? static_cast<uint16_t>((crc >> 1) ^ 0x8408) : static_cast<uint16_t>(crc >> 1);
+        }
+        table[byte] = crc;
+    }
+    return table;
+}
+
+inline constexpr std::array<uint16_t, 256> MAVLINK_CRC_TABLE = mavlink_make_crc_table();
+
+constexpr uint16_t MAVLINK_CRC_INIT = 0xFFFF;
+
+constexpr uint16_t mavlink_crc_accumulate(const uint8_t byte, const uint16_t crc) {
+    return static_cast<uint16_t>((crc >> 8) ^ MAVLINK_CRC_TABLE[(crc ^ byte) & 0xFF]);
+}
+
+inline uint16_t mavlink_crc_accumulate(std::span<const uint8_t> data, uint16_t crc) {
+    for (const uint8_t byte : data) {
+        crc = mavlink_crc_accumulate(byte, crc);
+    }
+    return crc;
+}
+
+// CRC_EXTRA of the messages this application understands. Frames with any other message id cannot be validated and are skipped.
+inline bool mavlink_crc_extra(const uint32_t msg_id, uint8_t &extra) {
+    switch (msg_id) {
+        case 0:   extra = 50;  return true;  // HEARTBEAT
+        case 1:   extra = 124; return true;  // SYS_STATUS
+        case 2:   extra = 137; return true;  // SYSTEM_TIME
+        case 20:  extra = 214; return true;  // PARAM_REQUEST_READ
+        case 21:  extra = 159; return true;  // PARAM_REQUEST_LIST
+        case 22:  extra = 220; return true;  // PARAM_VALUE
+        case 23:  extra = 168; return true;  // PARAM_SET
+        case 24:  extra = 24;  return true;  // GPS_RAW_INT
+        case 30:  extra = 39;  return true;  // ATTITUDE
+        case 33:  extra = 104; return true;  // GLOBAL_POSITION_INT
+        case 74:  extra = 20;  return true;  // VFR_HUD
+        case 253: extra = 83;  return true;  // STATUSTEXT
+        default:  return false;
+    }
+}
+
+struct DAQ_Mavlink_Frame {
+    uint8_t incompat_flags;
+    uint8_t compat_flags;
+    uint8_t seq;
+    uint8_t sysid;
+    uint8_t compid;
+    uint32_t msg_id;
+    // MAVLink v2 strips trailing zero bytes of the payload, so this may be shorter than the message definition
+    std::span<const uint8_t> payload;
+};
+
+// Serializes a v2 frame into out. Returns the number of bytes written, or 0 if out is too small or the message id is unknown.
+inline size_t mavlink_pack_frame(std::span<uint8_t> out, const uint8_t seq, const uint8_t sysid, const uint8_t compid,
+                                 const uint32_t msg_id, std::span<const uint8_t> payload) {
+
+    uint8_t extra;
+    if (!mavlink_crc_extra(msg_id, extra) || payload.size() > MAVLINK_MAX_PAYLOAD_LEN) {
+        return 0;
+    }
+
+    // Trailing zeros are not sent on the wire (at least one payload byte is always kept)
+    size_t length = payload.size();
+    while (length > 1 && payload[length - 1] == 0) {
+        length--;
+    }
+
+    const size_t frame_length = MAVLINK_HEADER_LEN + length + MAVLINK_CHECKSUM_LEN;
+    if (out.size() < frame_length) {
+        return 0;
+    }
+
+    out[0] = MAVLINK_STX_V2;
+    out[1] = static_cast<uint8_t>(length);
+    out[2] = 0;
+    out[3] = 0;
+    out[4] = seq;
+    out[5] = sysid;
+    out[6] = compid;
+    out[7] = static_cast<uint8_t>(msg_id & 0xFF);
+    out[8] = static_cast<uint8_t>((msg_id >> 8) & 0xFF);
+    out[9] = static_cast<uint8_t>((msg_id >> 16) & 0xFF);
+    std::memcpy(out.data() + MAVLINK_HEADER_LEN, payload.data(), length);
+
+    uint16_t crc = mavlink_crc_accumulate(out.subspan(1, MAVLINK_HEADER_LEN - 1 + length), MAVLINK_CRC_INIT);
+    crc = mavlink_crc_accumulate(extra, crc);
+    out[MAVLINK_HEADER_LEN + length] = static_cast<uint8_t>(crc & 0xFF);
+    out[MAVLINK_HEADER_LEN + length + 1] = static_cast<uint8_t>(crc >> 8);
+
+    return frame_length;
+}
+
+class DAQ_Mavlink_Parser {
+
+public:
+    DAQ_Mavlink_Parser() = default;
+
+    // Feeds the next chunk of the byte stream. Calls on_frame(const DAQ_Mavlink_Frame &) for every valid frame and returns
+    // how many there were
+    template <typename Callback>
+    size_t parse(std::span<const uint8_t> data, Callback &&on_frame) {
+
+        size_t frames = 0;
+        size_t position = 0;
+
+        // First finish the frame that was split across the previous read, if any
+        while (_carry_size > 0) {
+            const size_t wanted = _carry_size < MAVLINK_HEADER_LEN ? MAVLINK_HEADER_LEN : _frame_length(_carry.data());
+
+            if (_carry_size < wanted) {
+                const size_t count = std::min(wanted - _carry_size, data.size() - position);
+                std::memcpy(_carry.data() + _carry_size, data.data() + position, count);
+                _carry_size += count;
+                position += count;
+
+                if (_carry_size < wanted) {
+                    // Still incomplete, wait for the next read
+                    return frames;
+                }
+                continue;
+            }
+
+            DAQ_Mavlink_Frame frame;
+            if (_validate(_carry.data(), frame)) {
+                on_frame(frame);
+                frames++;
+                // After a resync the carry can hold the start of the next frame as well, keep it
+                const size_t frame_length = _frame_length(_carry.data());
+                std::memmove(_carry.data(), _carry.data() + frame_length, _carry_size - frame_length);
+                _carry_size -= frame_length;
+            } else {
+                // Not a frame after all, look for the next STX inside what we have buffered
+                _resync_carry();
+            }
+        }
+
+        // Fast path, frames are validated and handed over straight from the caller buffer
+        while (position < data.size()) {
+
+            // memchr is vectorized by the C library, much faster than a byte by byte loop when there is garbage on the line
+            const void *stx = std::memchr(data.data() + position, MAVLINK_STX_V2, data.size() - position);
+            if (stx == nullptr) {
+                break;
+            }
+
+            const size_t start = static_cast<size_t>(static_cast<const uint8_t *>(stx) - data.data());
+            const size_t remaining = data.size() - start;
+
+            if (remaining < MAVLINK_HEADER_LEN || remaining < _frame_length(data.data() + start)) {
+                std::memcpy(_carry.data(), data.data() + start, remaining);
+                _carry_size = remaining;
+                break;
+            }
+
+            DAQ_Mavlink_Frame frame;
+            if (_validate(data.data() + start, frame)) {
+                on_frame(frame);
+                frames++;
+                position = start + _frame_length(data.data() + start);
+            } else {
+                position = start + 1;
+            }
+        }
+
+        return frames;
+    }
+
+    void reset() { _carry_size = 0; }
+
+    size_t crc_errors() const { return _crc_errors; }
+    size_t unknown_messages() const { return _unknown_messages; }
+
+private:
+
+    static size_t _frame_length(const uint8_t *header) {
+        const bool is_signed = (header[2] & MAVLINK_INCOMPAT_FLAG_SIGNED) != 0;
+        return MAVLINK_HEADER_LEN + header[1] + MAVLINK_CHECKSUM_LEN + (is_signed ? MAVLINK_SIGNATURE_LEN : 0);
+    }
+
+    // frame points to a STX with at least _frame_length() bytes available
+    bool _validate(const uint8_t *bytes, DAQ_Mavlink_Frame &frame) {
+
+        // Unknown incompatibility flags mean we cannot interpret the frame
+        if ((bytes[2] & ~MAVLINK_INCOMPAT_FLAG_SIGNED) != 0) {
+            return false;
+        }
+
+        const uint8_t length = bytes[1];
+        const uint32_t msg_id = bytes[7] | (bytes[8] << 8) | (bytes[9] << 16);
+
+        uint8_t extra;
+        if (!mavlink_crc_extra(msg_id, extra)) {
+            _unknown_messages++;
+            return false;
+        }
+
+        uint16_t crc = mavlink_crc_accumulate(std::span<const uint8_t>(bytes + 1, MAVLINK_HEADER_LEN - 1 + length), MAVLINK_CRC_INIT);
+        crc = mavlink_crc_accumulate(extra, crc);
+
+        const uint16_t received = bytes[MAVLINK_HEADER_LEN + length] | (bytes[MAVLINK_HEADER_LEN + length + 1] << 8);
+        if (crc != received) {
+            _crc_errors++;
+            return false;
+        }
+
+        frame.incompat_flags = bytes[2];
+        frame.compat_flags = bytes[3];
+        frame.seq = bytes[4];
+        frame.sysid = bytes[5];
+        frame.compid = bytes[6];
+        frame.msg_id = msg_id;
+        frame.payload = std::span<const uint8_t>(bytes + MAVLINK_HEADER_LEN, length);
+        return true;
+    }
+
+    void _resync_carry() {
+        const void *stx = _carry_size > 1 ? std::memchr(_carry.data() + 1, MAVLINK_STX_V2, _carry_size - 1) : nullptr;
+
+        if (stx == nullptr) {
+            _carry_size = 0;
+            return;
+        }
+
+        const size_t offset = static_cast<size_t>(static_cast<const uint8_t *>(stx) - _carry.data());
+        std::memmove(_carry.data(), _carry.data() + offset, _carry_size - offset);
+        _carry_size -= offset;
+    }
+
+    std::array<uint8_t, MAVLINK_MAX_FRAME_LEN> _carry {};
+    size_t _carry_size = 0;
+
+    size_t _crc_errors = 0;
+    size_t _unknown_messages = 0;
+};
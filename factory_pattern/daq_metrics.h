@@ -0,0 +1,219 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/*
+ * Hot path instrumentation of the backends.
+ *
+ * Every backend owns a DAQ_Backend_Metrics. Its counters are only ever written by the thread running the update() of that backend
+ * (one thread at a time, see DAQ_App), so an increment is a relaxed load followed by a relaxed store: no lock prefix and no
+ * contention. Any other thread (e.g. the periodic dump) can read them at any time with snapshot(), it only ever sees values that are
+ * slightly behind.
+ *
+ * The update() latencies go into a log-linear histogram, the same idea as HdrHistogram: every power of two is split into
+ * 2^DAQ_LATENCY_SUB_BUCKET_BITS linear sub buckets. Recording is a handful of instructions, the memory is fixed, and every
+ * percentile is exact to within 1 / 2^DAQ_LATENCY_SUB_BUCKET_BITS (~6%) from nanoseconds up to minutes.
+ */
+
+constexpr unsigned DAQ_LATENCY_SUB_BUCKET_BITS = 4;
+constexpr uint64_t DAQ_LATENCY_SUB_BUCKETS = uint64_t {1} << DAQ_LATENCY_SUB_BUCKET_BITS;
+// Anything longer than 2^40 ns (~18 minutes) goes into the last bucket
+constexpr unsigned DAQ_LATENCY_MAX_EXPONENT = 40;
+constexpr size_t DAQ_LATENCY_BUCKETS = DAQ_LATENCY_SUB_BUCKETS * (DAQ_LATENCY_MAX_EXPONENT - DAQ_LATENCY_SUB_BUCKET_BITS + 2);
+
+// Values below DAQ_LATENCY_SUB_BUCKETS get a bucket each. Above, the exponent selects a group of sub buckets and the bits right after
+// the leading one select the sub bucket within the group
+constexpr size_t daq_latency_bucket(const uint64_t value_ns) {
+
+    if (value_ns < DAQ_LATENCY_SUB_BUCKETS) {
+        return static_cast<size_t>(value_ns);
+    }
+
+    const unsigned exponent = 63 - static_cast<unsigned>(std::countl_zero(value_ns));
+    if (exponent > DAQ_LATENCY_MAX_EXPONENT) {
+        return DAQ_LATENCY_BUCKETS - 1;
+    }
+
+    const unsigned shift = exponent - DAQ_LATENCY_SUB_BUCKET_BITS;
+    return static_cast<size_t>(DAQ_LATENCY_SUB_BUCKETS * shift + (value_ns >> shift));
+}
+
+// Smallest value that falls into the bucket
+constexpr uint64_t daq_latency_bucket_lower_bound(const size_t bucket) {
+
+    if (bucket < 2 * DAQ_LATENCY_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    const uint64_t shift = bucket / DAQ_LATENCY_SUB_BUCKETS - 1;
+    return (bucket % DAQ_LATENCY_SUB_BUCKETS + DAQ_LATENCY_SUB_BUCKETS) << shift;
+}
+
+static_assert(daq_latency_bucket(15) == 15 && daq_latency_bucket(16) == 16 && daq_latency_bucket(31) == 31);
+static_assert(daq_latency_bucket_lower_bound(daq_latency_bucket(1000)) <= 1000);
+static_assert(daq_latency_bucket_lower_bound(daq_latency_bucket(1000) + 1) > 1000);
+
+// Increment for counters that only have a single writer
+inline void daq_metrics_add(std::atomic<uint64_t> &counter, const uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+struct DAQ_Latency_Snapshot {
+    std::array<uint64_t, DAQ_LATENCY_BUCKETS> counts {};
+    uint64_t count = 0;
+    uint64_t max_ns = 0;
+
+    // percentile in [0, 1]. Returns the lower bound of the bucket holding that percentile
+    uint64_t percentile_ns(const double percentile) const {
+
+        if (count == 0) {
+            return 0;
+        }
+
+        const uint64_t target = static_cast<uint64_t>(percentile * static_cast<double>(count));
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < counts.size(); bucket++) {
+            seen += counts[bucket];
+            if (seen > target) {
+                return daq_latency_bucket_lower_bound(bucket);
+            }
+        }
+        return max_ns;
+    }
+};
+
+class DAQ_Latency_Histogram {
+
+public:
+    void record(const uint64_t value_ns) {
+        daq_metrics_add(_counts[daq_latency_bucket(value_ns)], 1);
+        if (value_ns > _max_ns.load(std::memory_order_relaxed)) {
+            _max_ns.store(value_ns, std::memory_order_relaxed);
+        }
+    }
+
+    void snapshot(DAQ_Latency_Snapshot &snapshot) const {
+        snapshot.count = 0;
+        for (size_t bucket = 0; bucket < DAQ_LATENCY_BUCKETS; bucket++) {
+            snapshot.counts[bucket] = _counts[bucket].load(std::memory_order_relaxed);
+            snapshot.count += snapshot.counts[bucket];
+        }
+        snapshot.max_ns = _max_ns.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, DAQ_LATENCY_BUCKETS> _counts {};
+    std::atomic<uint64_t> _max_ns {0};
+};
+
+struct DAQ_Metrics_Snapshot {
+    // Filled by whoever collects the snapshot (e.g. DAQ_App), the metrics do not know which backend they belong to
+    const char *protocol = "";
+    std::chrono::steady_clock::time_point time;
+
+    uint64_t updates = 0;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    uint64_t dropped_samples = 0;
+    uint64_t parse_errors = 0;
+
+    DAQ_Latency_Snapshot update_latency;
+};
+
+// Own cache lines, so the counters of a backend never share a line with whatever sits next to it
+class alignas(64) DAQ_Backend_Metrics {
+
+public:
+    void add_messages(const uint64_t messages, const uint64_t bytes) {
+        daq_metrics_add(_messages, messages);
+        daq_metrics_add(_bytes, bytes);
+    }
+    void add_dropped_samples(const uint64_t samples) { daq_metrics_add(_dropped_samples, samples); }
+    void add_parse_errors(const uint64_t errors) { daq_metrics_add(_parse_errors, errors); }
+
+    void record_update(const uint64_t duration_ns) {
+        daq_metrics_add(_updates, 1);
+        _update_latency.record(duration_ns);
+    }
+
+    uint64_t updates() const { return _updates.load(std::memory_order_relaxed); }
+    uint64_t messages() const { return _messages.load(std::memory_order_relaxed); }
+    uint64_t bytes() const { return _bytes.load(std::memory_order_relaxed); }
+    uint64_t dropped_samples() const { return _dropped_samples.load(std::memory_order_relaxed); }
+    uint64_t parse_errors() const { return _parse_errors.load(std::memory_order_relaxed); }
+
+    // Safe to call from any thread while the backend is running
+    void snapshot(DAQ_Metrics_Snapshot &snapshot) const {
+        snapshot.time = std::chrono::steady_clock::now();
+        snapshot.updates = updates();
+        snapshot.messages = messages();
+        snapshot.bytes = bytes();
+        snapshot.dropped_samples = dropped_samples();
+        snapshot.parse_errors = parse_errors();
+        _update_latency.snapshot(snapshot.update_latency);
+    }
+
+private:
+    std::atomic<uint64_t> _updates {0};
+    std::atomic<uint64_t> _messages {0};
+    std::atomic<uint64_t> _bytes {0};
+    std::atomic<uint64_t> _dropped_samples {0};
+    std::atomic<uint64_t> _parse_errors {0};
+
+    DAQ_Latency_Histogram _update_latency;
+};
+
+/*
+ * Calls dump() every period from a background thread, until destroyed. Reading the metrics never blocks the backends, so this can
+ * run in production and show which backend is saturating without attaching a profiler.
+ */
+class DAQ_Metrics_Reporter {
+
+public:
+    DAQ_Metrics_Reporter(const std::chrono::milliseconds period, std::function<void()> dump) :
+        _period(period), _dump(std::move(dump)) {
+        _thread = std::thread(&DAQ_Metrics_Reporter::_loop, this);
+    };
+
+    ~DAQ_Metrics_Reporter() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _cv.notify_all();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+    DAQ_Metrics_Reporter(const DAQ_Metrics_Reporter &) = delete;
+    DAQ_Metrics_Reporter &operator=(const DAQ_Metrics_Reporter &) = delete;
+
+private:
+    void _loop() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto next = std::chrono::steady_clock::now() + _period;
+        while (!_cv.wait_until(lock, next, [this] { return _stopping; })) {
+            lock.unlock();
+            _dump();
+            lock.lock();
+            next += _period;
+        }
+    }
+
+    std::chrono::milliseconds _period;
+    std::function<void()> _dump;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stopping = false;
+    std::thread _thread;
+};
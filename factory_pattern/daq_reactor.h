@@ -0,0 +1,145 @@
+#pragma once
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "daq_log.h"
+
+/*
+ * Small epoll based reactor.
+ *
+ * Instead of calling update() on every backend in a loop (and burning a core while nothing arrives), each backend registers the file
+ * descriptors it cares about (sockets, serial ports) and any periodic work as timers. wait() then sleeps in a single epoll_wait()
+ * until at least one of them is ready and reports the token of every ready registration, so the application only updates the
+ * backends that actually have something to do.
+ *
+ * Timers are implemented with timerfd so they are just another file descriptor for epoll. The reactor reads the expiration count
+ * itself, the backend only sees its token.
+ *
+ * File descriptors are registered level triggered: if a backend does not drain its socket completely, it simply gets woken up again.
+ */
+class DAQ_Reactor {
+
+public:
+    static constexpr size_t MAX_EVENTS = 64;
+
+    DAQ_Reactor() {
+        _epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (_epoll_fd < 0) {
+            spdlog::error("Fails to create epoll instance: {}", std::strerror(errno));
+        }
+    }
+
+    ~DAQ_Reactor() {
+        for (auto &registration : _registrations) {
+            if (registration->is_timer) {
+                ::close(registration->fd);
+            }
+        }
+        if (_epoll_fd >= 0) {
+            ::close(_epoll_fd);
+        }
+    }
+
+    DAQ_Reactor(const DAQ_Reactor &) = delete;
+    DAQ_Reactor &operator=(const DAQ_Reactor &) = delete;
+
+    // Wakes up whoever registered with this token when fd becomes readable. The reactor does not take ownership of fd
+    bool add_fd(const int fd, const uint64_t token) {
+        return _add(fd, token, false);
+    }
+
+    // Wakes up whoever registered with this token every period. Returns false if the timer could not be created
+    bool add_timer(const std::chrono::nanoseconds period, const uint64_t token) {
+
+        const int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0) {
+            spdlog::error("Fails to create timer: {}", std::strerror(errno));
+            return false;
+        }
+
+        itimerspec spec {};
+        spec.it_interval.tv_sec = static_cast<time_t>(period.count() / 1000000000);
+        spec.it_interval.tv_nsec = static_cast<long>(period.count() % 1000000000);
+        spec.it_value = spec.it_interval;
+
+        if (::timerfd_settime(fd, 0, &spec, nullptr) < 0 || !_add(fd, token, true)) {
+            ::close(fd);
+            return false;
+        }
+
+        return true;
+    }
+
+    // Blocks until something is ready or timeout_ms expires (-1 waits forever). Writes the tokens of the ready registrations into
+    // ready_tokens and returns how many there are. The same token can show up more than once if it registered several sources.
+    size_t wait(std::span<uint64_t> ready_tokens, const int timeout_ms) {
+
+        const int max_events = static_cast<int>(std::min(ready_tokens.size(), MAX_EVENTS));
+        const int count = ::epoll_wait(_epoll_fd, _events.data(), max_events, timeout_ms);
+
+        if (count < 0) {
+            if (errno != EINTR) {
+                DAQ_LOG_WARN("epoll_wait failed with errno {}", errno);
+            }
+            return 0;
+        }
+
+        for (int i = 0; i < count; i++) {
+            const Registration *registration = static_cast<const Registration *>(_events[i].data.ptr);
+
+            if (registration->is_timer) {
+                // Acknowledge the expiration, otherwise the timer stays readable forever
+                uint64_t expirations;
+                [[maybe_unused]] ssize_t bytes_read = ::read(registration->fd, &expirations, sizeof(expirations));
+            }
+
+            ready_tokens[i] = registration->token;
+        }
+
+        return static_cast<size_t>(count);
+    }
+
+private:
+
+    struct Registration {
+        int fd;
+        uint64_t token;
+        bool is_timer;
+    };
+
+    bool _add(const int fd, const uint64_t token, const bool is_timer) {
+
+        // Heap allocated so the pointer stored in epoll stays valid when the vector grows
+        auto registration = std::make_unique<Registration>(Registration{fd, token, is_timer});
+
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.ptr = registration.get();
+
+        if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            spdlog::error("Fails to register fd {} with epoll: {}", fd, std::strerror(errno));
+            return false;
+        }
+
+        _registrations.push_back(std::move(registration));
+        return true;
+    }
+
+    int _epoll_fd = -1;
+    std::vector<std::unique_ptr<Registration>> _registrations;
+    std::array<epoll_event, MAX_EVENTS> _events {};
+};
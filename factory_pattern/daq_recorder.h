@@ -0,0 +1,344 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#include "daq_capture_file.h"
+
+/*
+ * Append only recorder for DAQ_Mode::REAL_TIME sessions. The output is a capture file that DAQ_Playback can replay.
+ *
+ * Writing to disk from update() would stall acquisition every time the disk is slow, so the backends only copy their raw bytes into
+ * an in-memory chunk and a dedicated writer thread does the actual I/O:
+ *
+ *   backends --record()--> [active chunk] --full--> [writer thread] --pwrite()--> capture file
+ *                          [spare chunk ] <--written--
+ *
+ * There are exactly two chunks (double buffering). While the writer thread writes one, the backends fill the other. If the disk
+ * cannot keep up and both chunks are full, record() drops the data and counts it rather than blocking the backend.
+ *
+ * The lock shared by the backends is only held to reserve room in the active chunk. The copy into it happens after the lock is
+ * released, so backends recording at the same time copy in parallel. Every chunk counts the copies still in progress, and the writer
+ * thread waits for that count to drop to zero before it writes the chunk out.
+ *
+ * The file is opened with O_DIRECT when the file system supports it, so large recordings do not evict everything else from the page
+ * cache. O_DIRECT requires aligned buffers and aligned write sizes, which is why chunks are always written whole and their unused
+ * tail is filled with a padding record (playback skips those).
+ */
+class DAQ_Recorder {
+
+public:
+    static constexpr size_t BLOCK_SIZE = 4096;
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+
+    explicit DAQ_Recorder(const size_t chunk_size = DEFAULT_CHUNK_SIZE) :
+        _chunk_size((chunk_size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE) {};
+
+    ~DAQ_Recorder() { close(); }
+
+    DAQ_Recorder(const DAQ_Recorder &) = delete;
+    DAQ_Recorder &operator=(const DAQ_Recorder &) = delete;
+
+    bool open(const std::string &path) {
+
+        for (Chunk &chunk : _chunks) {
+            chunk.data = static_cast<uint8_t *>(std::aligned_alloc(BLOCK_SIZE, _chunk_size));
+            chunk.used = 0;
+            chunk.state = Chunk_State::FREE;
+            if (chunk.data == nullptr) {
+                spdlog::error("Fails to allocate the {} byte chunks of recording {}", _chunk_size, path);
+                _free_chunks();
+                return false;
+            }
+        }
+
+        _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+        if (_fd < 0 && errno == EINVAL) {
+            // tmpfs and a few others do not support O_DIRECT, fall back to buffered writes
+            _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        }
+        if (_fd < 0) {
+            spdlog::error("Fails to open recording {}: {}", path, std::strerror(errno));
+            _free_chunks();
+            return false;
+        }
+
+        _file_offset = 0;
+        _active = 0;
+        _chunks[_active].state = Chunk_State::FILLING;
+
+        DAQ_Capture_File_Header header {};
+        std::memcpy(header.magic, DAQ_CAPTURE_MAGIC, sizeof(header.magic));
+        header.version = DAQ_CAPTURE_VERSION;
+        std::memcpy(_chunks[_active].data, &header, sizeof(header));
+        _chunks[_active].used = sizeof(header);
+
+        _closing = false;
+        _stopping = false;
+        _writer_done = false;
+        _writer = std::thread(&DAQ_Recorder::_writer_loop, this);
+
+        spdlog::info("Recording to {}", path);
+        return true;
+    }
+
+    bool is_open() const { return _fd >= 0; }
+
+    // Called by the backends, from any thread. Only copies into memory, never waits for the disk
+    bool record(const uint16_t protocol, std::span<const uint8_t> payload) {
+
+        const size_t record_size = sizeof(DAQ_Capture_Record_Header) + payload.size();
+        if (record_size + sizeof(DAQ_Capture_Record_Header) > _chunk_size) {
+            _dropped_records.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        Chunk *chunk = nullptr;
+        uint8_t *destination = nullptr;
+        uint64_t timestamp_ns = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            // Taken under the lock so records from concurrent backends are appended in timestamp order, and from the monotonic clock
+            // so an NTP step can not move the time line backwards. Playback only ever looks at the differences
+            timestamp_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+
+            if (_fd < 0 || _closing) {
+                return false;
+            }
+
+            if (!_fits(_chunks[_active], record_size)) {
+                Chunk &spare = _chunks[1 - _active];
+                if (spare.state != Chunk_State::FREE) {
+                    // The writer is still busy with the previous chunk, the disk is not keeping up
+                    _dropped_records.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+
+                _seal(_chunks[_active], _chunk_size);
+                _active = 1 - _active;
+                spare.state = Chunk_State::FILLING;
+                spare.used = 0;
+                _cv.notify_all();
+            }
+
+            // Reserve the room, the chunk can not be written out before our copy is done
+            chunk = &_chunks[_active];
+            destination = chunk->data + chunk->used;
+            chunk->used += record_size;
+            chunk->copies.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        const DAQ_Capture_Record_Header header {timestamp_ns, static_cast<uint32_t>(payload.size()), protocol, 0};
+        std::memcpy(destination, &header, sizeof(header));
+        std::memcpy(destination + sizeof(header), payload.data(), payload.size());
+        // Publishes the copy to the writer thread
+        chunk->copies.fetch_sub(1, std::memory_order_release);
+
+        _recorded_records.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Flushes whatever is left in the active chunk and waits for the writer to be done with it. If the disk is still busy at
+    // deadline, the recording is abandoned: the file misses its last chunks, and the writer thread is left to finish on its own.
+    // It still uses the recorder, so an abandoned recorder must never be destroyed (the owner leaks it, see ~DAQ_App()).
+    // Returns false if the recording was abandoned (or already had been)
+    bool close(const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_fd < 0) {
+                return true;
+            }
+            if (_closing) {
+                return false;
+            }
+            // From now on record() turns everyone away
+            _closing = true;
+
+            // Wait for the spare to be written out, then hand over the partially filled chunk, rounded up to a whole block
+            if (!_cv.wait_until(lock, deadline, [this] { return _chunks[1 - _active].state == Chunk_State::FREE; })) {
+                _abandon();
+                return false;
+            }
+
+            Chunk &chunk = _chunks[_active];
+            if (chunk.used > 0) {
+                const size_t padded = std::min(_chunk_size,
+                    (chunk.used + sizeof(DAQ_Capture_Record_Header) + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE);
+                _seal(chunk, padded);
+            }
+
+            _stopping = true;
+            _cv.notify_all();
+
+            if (!_cv.wait_until(lock, deadline, [this] { return _writer_done; })) {
+                _abandon();
+                return false;
+            }
+        }
+
+        if (_writer.joinable()) {
+            _writer.join();
+        }
+
+        {
+            // record() checks _fd under the lock, so a backend still recording at this point is turned away instead of writing into
+            // freed chunks
+            std::lock_guard<std::mutex> lock(_mutex);
+            ::close(_fd);
+            _fd = -1;
+            _free_chunks();
+        }
+
+        spdlog::info("Recording closed: {} records written, {} dropped", recorded_records(), dropped_records());
+        return true;
+    }
+
+    size_t recorded_records() const { return _recorded_records.load(std::memory_order_relaxed); }
+    size_t dropped_records() const { return _dropped_records.load(std::memory_order_relaxed); }
+
+private:
+
+    enum class Chunk_State {
+        FREE,
+        FILLING,
+        SEALED,
+    };
+
+    struct Chunk {
+        uint8_t *data = nullptr;
+        size_t used = 0;
+        // Size that will be written, used rounded up to keep O_DIRECT happy
+        size_t write_size = 0;
+        Chunk_State state = Chunk_State::FREE;
+        // Records reserved in the chunk whose copy has not finished yet. Only ever incremented under _mutex
+        std::atomic<size_t> copies {0};
+    };
+
+    // Called with _mutex held, when close() runs out of time. The file descriptor and the chunks stay with the writer thread
+    void _abandon() {
+        spdlog::error("Recording still waiting on the disk at the deadline, abandoning what was not written yet");
+        _stopping = true;
+        _cv.notify_all();
+        _writer.detach();
+    }
+
+    void _free_chunks() {
+        for (Chunk &chunk : _chunks) {
+            std::free(chunk.data);
+            chunk.data = nullptr;
+        }
+    }
+
+    // A record fits if it fills the chunk exactly, or leaves enough room for at least a padding record header
+    bool _fits(const Chunk &chunk, const size_t record_size) const {
+        const size_t remaining = _chunk_size - chunk.used;
+        return record_size == remaining || record_size + sizeof(DAQ_Capture_Record_Header) <= remaining;
+    }
+
+    // Pads the chunk up to write_size with a single padding record and hands it to the writer. Called with _mutex held
+    void _seal(Chunk &chunk, const size_t write_size) {
+
+        const size_t remaining = write_size - chunk.used;
+        if (remaining > 0) {
+            const DAQ_Capture_Record_Header padding {0, static_cast<uint32_t>(remaining - sizeof(DAQ_Capture_Record_Header)),
+                                                     0, DAQ_CAPTURE_RECORD_PADDING};
+            std::memcpy(chunk.data + chunk.used, &padding, sizeof(padding));
+            std::memset(chunk.data + chunk.used + sizeof(padding), 0, remaining - sizeof(padding));
+        }
+
+        chunk.write_size = write_size;
+        chunk.state = Chunk_State::SEALED;
+    }
+
+    void _writer_loop() {
+
+        while (true) {
+            Chunk *chunk = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this] {
+                    return _stopping || _chunks[0].state == Chunk_State::SEALED || _chunks[1].state == Chunk_State::SEALED;
+                });
+
+                for (Chunk &candidate : _chunks) {
+                    if (candidate.state == Chunk_State::SEALED) {
+                        chunk = &candidate;
+                        break;
+                    }
+                }
+
+                if (chunk == nullptr) {
+                    // Stopping and nothing left to write
+                    _writer_done = true;
+                    _cv.notify_all();
+                    return;
+                }
+            }
+
+            // Sealed, so no new copies can start. The ones still running are a memcpy of at most a chunk each, not worth a wakeup
+            while (chunk->copies.load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+
+            // The chunk is ours until we mark it free again, so the disk write happens without holding the lock
+            size_t written = 0;
+            while (written < chunk->write_size) {
+                const ssize_t result = ::pwrite(_fd, chunk->data + written, chunk->write_size - written,
+                                                static_cast<off_t>(_file_offset + written));
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    spdlog::error("Recording write failed: {}", std::strerror(errno));
+                    break;
+                }
+                written += static_cast<size_t>(result);
+            }
+            _file_offset += chunk->write_size;
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                chunk->used = 0;
+                chunk->state = Chunk_State::FREE;
+            }
+            _cv.notify_all();
+        }
+    }
+
+    const size_t _chunk_size;
+    int _fd = -1;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    Chunk _chunks[2];
+    size_t _active = 0;
+    // Set by close(): _closing turns record() away, _stopping tells the writer to exit once nothing is sealed anymore
+    bool _closing = false;
+    bool _stopping = false;
+    bool _writer_done = false;
+
+    // Only touched by the writer thread
+    size_t _file_offset = 0;
+    std::thread _writer;
+
+    std::atomic<size_t> _recorded_records{0};
+    std::atomic<size_t> _dropped_records{0};
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+/*
+ * Fixed capacity single producer / single consumer ring buffer.
+ *
+ * The producer is the backend (inside update()) and the consumer is the application (inside get_latest_data()). Since there is
+ * exactly one of each, we do not need any lock, only two indices:
+ *   * _head - written by the producer only, tells the consumer how far it can read
+ *   * _tail - written by the consumer only, tells the producer how much space was freed
+ *
+ * Both indices live on their own cache line, otherwise every push would invalidate the cache line the consumer is polling
+ * (false sharing). Each side also keeps a cached copy of the other side's index, so in the common case a push or a pop does not
+ * touch the other thread's cache line at all.
+ *
+ * Capacity has to be a power of two so that wrapping around is a cheap mask instead of a modulo. The storage is a plain std::array
+ * allocated together with the ring, so pushing and popping never allocates.
+ */
+template <typename T, size_t Capacity>
+class DAQ_Ring_Buffer {
+
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static_assert(std::is_trivially_copyable_v<T>, "Ring buffer only holds trivially copyable samples");
+
+public:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    DAQ_Ring_Buffer() = default;
+
+    DAQ_Ring_Buffer(const DAQ_Ring_Buffer &) = delete;
+    DAQ_Ring_Buffer &operator=(const DAQ_Ring_Buffer &) = delete;
+
+    static constexpr size_t capacity() { return Capacity; }
+
+    // Producer side. Returns false if the consumer has not caught up and the ring is full (the sample is dropped)
+    bool try_push(const T &value) {
+        const size_t head = _head.load(std::memory_order_relaxed);
+
+        if (head - _cached_tail == Capacity) {
+            _cached_tail = _tail.load(std::memory_order_acquire);
+            if (head - _cached_tail == Capacity) {
+                return false;
+            }
+        }
+
+        _buffer[head & MASK] = value;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if there is nothing to read
+    bool try_pop(T &value) {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+
+        if (tail == _cached_head) {
+            _cached_head = _head.load(std::memory_order_acquire);
+            if (tail == _cached_head) {
+                return false;
+            }
+        }
+
+        value = _buffer[tail & MASK];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Pops everything currently available and hands every element to the callback. Only publishes the new tail
+    // once at the end, so draining a full ring costs a single atomic store.
+    template <typename Callback>
+    size_t drain(Callback &&callback) {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        const size_t head = _head.load(std::memory_order_acquire);
+        _cached_head = head;
+
+        for (size_t i = tail; i != head; i++) {
+            callback(_buffer[i & MASK]);
+        }
+
+        _tail.store(head, std::memory_order_release);
+        return head - tail;
+    }
+
+    // Approximate when called from a thread that is neither the producer nor the consumer
+    size_t size() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr size_t MASK = Capacity - 1;
+
+    // Producer cache line
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _head{0};
+    size_t _cached_tail = 0;
+
+    // Consumer cache line
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _tail{0};
+    size_t _cached_head = 0;
+
+    alignas(CACHE_LINE_SIZE) std::array<T, Capacity> _buffer{};
+};
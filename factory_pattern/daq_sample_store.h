@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <span>
+
+#include "daq_aggregator.h"
+
+/*
+ * Columnar (structure of arrays) store of timestamped multi channel samples.
+ *
+ * get_latest_data() hands out a flat std::vector<float>: no channels, no timestamps. Storing rows as interleaved records
+ * ({time, ch0, ch1, ch2}, {time, ch0, ...}) fixes that, but then a scan of a single channel drags every other channel through the
+ * cache with it and the compiler can not vectorise the loop. Here every channel is a contiguous column instead:
+ *
+ *   chunk 0:  timestamps [t0 t1 t2 ... ]      chunk 1:  timestamps [ ... ]
+ *             channel 0  [v0 v1 v2 ... ]                channel 0  [ ... ]
+ *             channel 1  [v0 v1 v2 ... ]                channel 1  [ ... ]
+ *
+ * so scanning a channel reads nothing but that channel, a cache line at a time, and runs through the same SIMD reduction as
+ * DAQ_Aggregator (see aggregate()).
+ *
+ * The columns are split in chunks of rows_per_chunk rows (one allocation per chunk, every column cache line aligned), so the store
+ * grows without ever moving what readers may be looking at. The store is a ring of max_chunks chunks: once they are all full, the
+ * oldest chunk is retired and its memory reused for the next rows_per_chunk rows. Rows keep their number for good (row n is the n-th
+ * row ever appended), the ones still held are [oldest_row(), rows()), i.e. between (max_chunks - 1) and max_chunks chunks of the
+ * latest rows.
+ *
+ * There is a single writer (the backend the store is attached to, see DAQ_Backend::set_sample_store()) and any number of readers,
+ * none of which ever take a lock:
+ *   * the writer fills the row, then publishes it by bumping the row count with a release store
+ *   * a reader loads the row count with acquire, and everything below it (rows and the chunks holding them) is complete
+ *   * before the writer reuses a chunk, it moves oldest_row() past it. A reader that was looking at that chunk at the same time may
+ *     have read rows that were being overwritten, so it checks oldest_row() again after reading, like the reader of a seqlock:
+ *     scan() returns the first row that was still intact, and aggregate() redoes whatever the writer overtook
+ * Chunks are only freed with the store, so a reader can never see memory disappear under it, at worst be overwritten.
+ */
+class DAQ_Sample_Store {
+
+public:
+    static constexpr size_t DEFAULT_ROWS_PER_CHUNK = 4096;
+    static constexpr size_t DEFAULT_MAX_CHUNKS = 256;
+    static constexpr size_t ALIGNMENT = 64;
+
+    DAQ_Sample_Store(const size_t channels, const size_t rows_per_chunk = DEFAULT_ROWS_PER_CHUNK,
+                     const size_t max_chunks = DEFAULT_MAX_CHUNKS) :
+        _channels(std::max<size_t>(channels, 1)),
+        _rows_per_chunk(std::max<size_t>(rows_per_chunk, 1)),
+        _max_chunks(std::max<size_t>(max_chunks, 1)),
+        _timestamps_bytes(_round_up(_rows_per_chunk * sizeof(uint64_t))),
+        _column_bytes(_round_up(_rows_per_chunk * sizeof(float))),
+        _chunks(std::make_unique<std::atomic<uint8_t *>[]>(_max_chunks)) {};
+
+    ~DAQ_Sample_Store() {
+        for (size_t i = 0; i < _max_chunks; i++) {
+            std::free(_chunks[i].load(std::memory_order_relaxed));
+        }
+    }
+
+    DAQ_Sample_Store(const DAQ_Sample_Store &) = delete;
+    DAQ_Sample_Store &operator=(const DAQ_Sample_Store &) = delete;
+
+    // Writer only. values holds one value per channel, missing channels are stored as 0 and extra values ignored. Once the ring is
+    // full, the first row of every new chunk retires the oldest one. Returns false (and counts the row as dropped) only if a chunk
+    // can not be allocated
+    bool append(const uint64_t timestamp_ns, std::span<const float> values) {
+
+        const size_t chunk_index = _written / _rows_per_chunk;
+        const size_t row = _written % _rows_per_chunk;
+        const size_t slot = chunk_index % _max_chunks;
+
+        if (row == 0 && chunk_index >= _max_chunks) {
+            // Retire the chunk about to be reused before writing into it. The fence keeps the rows written below from becoming
+            // visible before the new oldest row, so a reader that saw any of them also sees it moved
+            _oldest.store((chunk_index - _max_chunks + 1) * _rows_per_chunk, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        uint8_t *chunk = _chunks[slot].load(std::memory_order_relaxed);
+        if (chunk == nullptr) {
+            // Once every rows_per_chunk rows
+            chunk = static_cast<uint8_t *>(std::aligned_alloc(ALIGNMENT, _timestamps_bytes + _channels * _column_bytes));
+            if (chunk == nullptr) {
+                _dropped_rows.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            _chunks[slot].store(chunk, std::memory_order_relaxed);
+        }
+
+        _timestamps(chunk)[row] = timestamp_ns;
+        const size_t provided = std::min(values.size(), _channels);
+        for (size_t channel = 0; channel < provided; channel++) {
+            _column(chunk, channel)[row] = values[channel];
+        }
+        for (size_t channel = provided; channel < _channels; channel++) {
+            _column(chunk, channel)[row] = 0.0f;
+        }
+
+        _written++;
+        // Publishes the row and, for its first row, the chunk pointer stored above
+        _rows.store(_written, std::memory_order_release);
+        return true;
+    }
+
+    // Any thread. Number of rows appended so far, every row below this is complete
+    size_t rows() const { return _rows.load(std::memory_order_acquire); }
+    // Any thread. First row still held, the ones before it were retired with their chunk
+    size_t oldest_row() const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return _oldest.load(std::memory_order_relaxed);
+    }
+
+    size_t channels() const { return _channels; }
+    size_t rows_per_chunk() const { return _rows_per_chunk; }
+    // Most rows held at once
+    size_t capacity() const { return _rows_per_chunk * _max_chunks; }
+    uint64_t dropped_rows() const { return _dropped_rows.load(std::memory_order_relaxed); }
+
+    // Any thread. Calls function(timestamps, values) with contiguous pieces of the channel column covering rows [from_row, to_row),
+    // one piece per chunk, oldest first. The range is clamped to [oldest_row(), rows()). Returns the first row of the range that was
+    // still intact once the scan was done: if the writer retired chunks in the meantime, the pieces before it may have been
+    // overwritten while function was reading them
+    template <typename Function>
+    size_t scan(const size_t channel, size_t from_row, size_t to_row, Function &&function) const {
+
+        to_row = std::min(to_row, rows());
+        from_row = std::max(from_row, oldest_row());
+        const size_t start_row = from_row;
+
+        if (channel >= _channels) {
+            return start_row;
+        }
+
+        while (from_row < to_row) {
+            const size_t chunk_index = from_row / _rows_per_chunk;
+            const size_t first = from_row % _rows_per_chunk;
+            const size_t count = std::min(_rows_per_chunk - first, to_row - from_row);
+
+            const uint8_t *chunk = _chunks[chunk_index % _max_chunks].load(std::memory_order_relaxed);
+            function(std::span<const uint64_t>(_timestamps(chunk) + first, count),
+                     std::span<const float>(_column(chunk, channel) + first, count));
+
+            from_row += count;
+        }
+
+        return std::max(start_row, oldest_row());
+    }
+
+    // min/max/mean/last of a channel over rows [from_row, to_row), with the SIMD reduction of daq_aggregator.h. Rows the writer
+    // overtook during the scan are left out and the rest is scanned again, so the result only ever covers intact rows
+    DAQ_Aggregate aggregate(const size_t channel, size_t from_row, const size_t to_row) const {
+        while (true) {
+            DAQ_Aggregate aggregate;
+            from_row = std::max(from_row, oldest_row());
+            const size_t intact_from = scan(channel, from_row, to_row,
+                                            [&aggregate](std::span<const uint64_t>, std::span<const float> values) {
+                                                aggregate.merge(daq_reduce(values));
+                                            });
+            if (intact_from == from_row) {
+                return aggregate;
+            }
+            from_row = intact_from;
+        }
+    }
+
+    // Any thread, row has to be in [oldest_row(), rows()). Check oldest_row() again after reading to be sure the row was not
+    // retired meanwhile
+    uint64_t timestamp(const size_t row) const { return _timestamps(_chunk_of(row))[row % _rows_per_chunk]; }
+    float value(const size_t row, const size_t channel) const { return _column(_chunk_of(row), channel)[row % _rows_per_chunk]; }
+
+private:
+    const uint8_t *_chunk_of(const size_t row) const {
+        return _chunks[(row / _rows_per_chunk) % _max_chunks].load(std::memory_order_relaxed);
+    }
+
+    static size_t _round_up(const size_t bytes) { return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+    // Layout of a chunk: the timestamps column, then one column per channel
+    uint64_t *_timestamps(uint8_t *chunk) const { return reinterpret_cast<uint64_t *>(chunk); }
+    const uint64_t *_timestamps(const uint8_t *chunk) const { return reinterpret_cast<const uint64_t *>(chunk); }
+    float *_column(uint8_t *chunk, const size_t channel) const {
+        return reinterpret_cast<float *>(chunk + _timestamps_bytes + channel * _column_bytes);
+    }
+    const float *_column(const uint8_t *chunk, const size_t channel) const {
+        return reinterpret_cast<const float *>(chunk + _timestamps_bytes + channel * _column_bytes);
+    }
+
+    const size_t _channels;
+    const size_t _rows_per_chunk;
+    const size_t _max_chunks;
+    const size_t _timestamps_bytes;
+    const size_t _column_bytes;
+
+    // Allocated once, so readers can index it while the writer adds chunks
+    std::unique_ptr<std::atomic<uint8_t *>[]> _chunks;
+
+    // Writer side
+    size_t _written = 0;
+
+    // Read by everyone, kept away from the writer's fields
+    alignas(ALIGNMENT) std::atomic<size_t> _rows {0};
+    std::atomic<size_t> _oldest {0};
+    std::atomic<uint64_t> _dropped_rows {0};
+};
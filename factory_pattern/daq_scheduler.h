@@ -0,0 +1,206 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+/*
+ * Worker pool used by DAQ_App to run the update() of every backend concurrently.
+ *
+ * Each worker owns two queues:
+ *   * pinned queue  - tasks that must run on this worker (e.g. a backend that owns a UART and should stay on one core)
+ *   * shared queue  - tasks that were only assigned to this worker round robin. Idle workers are allowed to steal these
+ *
+ * A worker always drains its pinned queue first, then pops the newest task from its own shared queue (cache is still warm),
+ * and only when both are empty it tries to steal the oldest task from the shared queue of another worker. This way one slow
+ * backend only ever blocks the worker it is running on, and the rest of the backends get picked up by whoever is free.
+ *
+ * NOTE: The queues are protected by a mutex per worker. With a dozen backends per tick the contention is negligible, so I did
+ * not go down the route of a lock-free Chase-Lev deque here.
+ */
+class DAQ_Scheduler {
+
+public:
+    using Task = std::function<void()>;
+
+    static constexpr int NO_PINNING = -1;
+
+    explicit DAQ_Scheduler(size_t num_workers = std::thread::hardware_concurrency(), bool pin_workers_to_cores = false) {
+
+        if (num_workers == 0) {
+            num_workers = 1;
+        }
+
+        for (size_t i = 0; i < num_workers; i++) {
+            _workers.push_back(std::make_unique<Worker>());
+        }
+
+        // hardware_concurrency() may return 0 as well when the core count is unknown
+        size_t num_cores = std::thread::hardware_concurrency();
+        if (num_cores == 0) {
+            num_cores = 1;
+        }
+
+        for (size_t i = 0; i < num_workers; i++) {
+            _workers[i]->thread = std::thread(&DAQ_Scheduler::_worker_loop, this, i);
+
+            if (pin_workers_to_cores) {
+                _pin_thread_to_core(_workers[i]->thread, i % num_cores);
+            }
+        }
+    }
+
+    ~DAQ_Scheduler() {
+        {
+            std::lock_guard<std::mutex> lock(_wake_mutex);
+            _stopping = true;
+        }
+        _wake_cv.notify_all();
+
+        for (auto &worker : _workers) {
+            if (worker->thread.joinable()) {
+                worker->thread.join();
+            }
+        }
+    }
+
+    DAQ_Scheduler(const DAQ_Scheduler &) = delete;
+    DAQ_Scheduler &operator=(const DAQ_Scheduler &) = delete;
+
+    size_t num_workers() const { return _workers.size(); }
+
+    // Queue a task. If pinned_worker is a valid worker index, only that worker will ever run it
+    void submit(Task task, int pinned_worker = NO_PINNING) {
+
+        _pending.fetch_add(1, std::memory_order_relaxed);
+
+        if (pinned_worker >= 0 && static_cast<size_t>(pinned_worker) < _workers.size()) {
+            Worker &worker = *_workers[pinned_worker];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.pinned.push_back(std::move(task));
+        } else {
+            size_t index = _next_worker.fetch_add(1, std::memory_order_relaxed) % _workers.size();
+            Worker &worker = *_workers[index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.shared.push_back(std::move(task));
+        }
+
+        {
+            // Taking the lock here avoids a lost wake up between a worker checking the queues and going to sleep
+            std::lock_guard<std::mutex> lock(_wake_mutex);
+            ++_wake_generation;
+        }
+        _wake_cv.notify_all();
+    }
+
+    // Blocks until every task submitted so far has finished running
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(_idle_mutex);
+        _idle_cv.wait(lock, [this] { return _pending.load(std::memory_order_acquire) == 0; });
+    }
+
+private:
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> pinned;
+        std::deque<Task> shared;
+        std::thread thread;
+    };
+
+    bool _pop_local(size_t index, Task &task) {
+        Worker &worker = *_workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+
+        if (!worker.pinned.empty()) {
+            task = std::move(worker.pinned.front());
+            worker.pinned.pop_front();
+            return true;
+        }
+
+        if (!worker.shared.empty()) {
+            task = std::move(worker.shared.back());
+            worker.shared.pop_back();
+            return true;
+        }
+
+        return false;
+    }
+
+    bool _steal(size_t thief, Task &task) {
+        for (size_t offset = 1; offset < _workers.size(); offset++) {
+            Worker &victim = *_workers[(thief + offset) % _workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+
+            // Never steal pinned tasks, those belong to the victim only
+            if (!victim.shared.empty()) {
+                task = std::move(victim.shared.front());
+                victim.shared.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void _worker_loop(size_t index) {
+        Task task;
+
+        while (true) {
+            uint64_t generation;
+            {
+                std::lock_guard<std::mutex> lock(_wake_mutex);
+                generation = _wake_generation;
+            }
+
+            if (_pop_local(index, task) || _steal(index, task)) {
+                task();
+                task = nullptr;
+
+                if (_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    std::lock_guard<std::mutex> lock(_idle_mutex);
+                    _idle_cv.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(_wake_mutex);
+            if (_stopping) {
+                return;
+            }
+            _wake_cv.wait(lock, [&] { return _stopping || _wake_generation != generation; });
+        }
+    }
+
+    static void _pin_thread_to_core(std::thread &thread, size_t core) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(core, &cpu_set);
+
+        if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpu_set) != 0) {
+            spdlog::warn("Fails to pin scheduler worker to core {}", core);
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<size_t> _next_worker{0};
+    std::atomic<size_t> _pending{0};
+
+    std::mutex _wake_mutex;
+    std::condition_variable _wake_cv;
+    uint64_t _wake_generation = 0;
+    bool _stopping = false;
+
+    std::mutex _idle_mutex;
+    std::condition_variable _idle_cv;
+};
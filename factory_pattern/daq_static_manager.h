@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "daq_app.h"
+
+/*
+ * Compile time alternative to the backend manager of DAQ_App.
+ *
+ * DAQ_App keeps a std::vector<std::unique_ptr<DAQ_Backend>>: every backend is a separate heap allocation, and every tick calls
+ * update() through the vtable, which the compiler can neither predict nor inline. That is the price of being able to add any
+ * backend at run time.
+ *
+ * When the set of backend types is known at compile time, DAQ_Static_Manager stores the backends by value in a single array of
+ * std::variant<Backends...>. The backends sit next to each other in memory, and std::visit turns the dispatch into a switch on the
+ * variant index followed by a direct call on the concrete (final) type, which the compiler is free to inline.
+ *
+ *   DAQ_Static_Manager<DAQ_UDP, DAQ_Mavlink> manager(2);
+ *   manager.emplace<DAQ_UDP>();
+ *   manager.emplace<DAQ_Mavlink>(14551);
+ *   manager.init();
+ *   while (...) {
+ *       manager.update();
+ *       process(manager.get_latest_data());
+ *   }
+ *   manager.shutdown();
+ *
+ * The backends own atomics and sockets, so they can not be moved. The array is therefore sized once in the constructor and the
+ * backends are constructed in place with emplace().
+ *
+ * Unlike DAQ_App, the manager runs every backend on the calling thread (no scheduler, no reactor). See daq_bench for how both paths
+ * compare.
+ */
+template <typename... Backends>
+class DAQ_Static_Manager {
+
+    static_assert(sizeof...(Backends) > 0, "DAQ_Static_Manager needs at least one backend type");
+    static_assert((std::is_base_of_v<DAQ_Backend, Backends> && ...), "Every backend must derive from DAQ_Backend");
+    static_assert((std::is_final_v<Backends> && ...),
+                  "Backends must be final, otherwise the calls through the variant can not be devirtualized");
+
+public:
+    // std::monostate marks a slot that has not been emplaced yet
+    using Slot = std::variant<std::monostate, Backends...>;
+
+    explicit DAQ_Static_Manager(const size_t capacity) :
+        _slots(std::make_unique<Slot[]>(capacity)), _capacity(capacity) {
+        // Enough room for a full ring of every backend, so draining never allocates
+        _latest_data.reserve(capacity * DAQ_Backend::Sample_Ring::capacity());
+    };
+
+    DAQ_Static_Manager(const DAQ_Static_Manager &) = delete;
+    DAQ_Static_Manager &operator=(const DAQ_Static_Manager &) = delete;
+
+    // Constructs the next backend in place. Returns nullptr once every slot given to the constructor is used
+    template <typename Backend, typename... Args>
+    Backend *emplace(Args &&...args) {
+        if (_size == _capacity) {
+            return nullptr;
+        }
+        return &_slots[_size++].template emplace<Backend>(std::forward<Args>(args)...);
+    }
+
+    size_t size() const { return _size; }
+
+    // Calls function(backend) with the concrete type of every backend, in the order they were emplaced
+    template <typename Function>
+    void for_each(Function &&function) {
+        for (size_t i = 0; i < _size; i++) {
+            std::visit([&function](auto &backend) {
+                if constexpr (!std::is_same_v<std::decay_t<decltype(backend)>, std::monostate>) {
+                    function(backend);
+                }
+            }, _slots[i]);
+        }
+    }
+
+    // Returns false if any backend failed to initialize, every backend is still given a chance to
+    bool init() {
+        bool success = true;
+        for_each([&success](auto &backend) { success = backend.init() && success; });
+        return success;
+    }
+
+    void update() {
+        for_each([](auto &backend) { daq_backend_update(backend); });
+    }
+
+    void shutdown() {
+        for_each([](auto &backend) { backend.shutdown(); });
+    }
+
+    // Same contract as DAQ_App::get_latest_data(): always called from the same thread, valid until the next call
+    const std::vector<float> &get_latest_data() {
+        _latest_data.clear();
+        for_each([this](auto &backend) {
+            backend.samples().drain([this](const float sample) { _latest_data.push_back(sample); });
+        });
+        return _latest_data;
+    }
+
+private:
+    std::unique_ptr<Slot[]> _slots;
+    size_t _capacity;
+    size_t _size = 0;
+
+    std::vector<float> _latest_data;
+};
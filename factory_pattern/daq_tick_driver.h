@@ -0,0 +1,141 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+#include "daq_metrics.h"
+
+/*
+ * Fixed rate tick driver for acquiring at a configured sample rate (see DAQ_App::get_sample_rate_ms()).
+ *
+ * The obvious loop, "do the work, then sleep for the period", drifts: every tick is late by however long the work and the wake up
+ * took, and that error accumulates. Instead, the deadlines are absolute (start + n * period) and the driver sleeps with
+ * clock_nanosleep(TIMER_ABSTIME) until the next one, so a late tick does not push every tick after it.
+ *
+ * The kernel usually wakes a sleeping thread up some tens of microseconds late. To get below that, the driver can sleep until
+ * spin before the deadline and busy-wait the rest. That burns a core, which is the point of running it on an isolated one
+ * (isolcpus, pin_current_thread(), set_realtime_priority()).
+ *
+ * Every tick records its jitter (how late it started, in ns) in a DAQ_Latency_Histogram. A tick whose deadline had already passed
+ * when wait_next_tick() was called is an overrun: the work took longer than the period. The driver then returns immediately and, if
+ * whole periods were lost, skips them instead of running a burst of back to back ticks to catch up.
+ */
+
+struct DAQ_Tick_Statistics {
+    uint64_t ticks = 0;
+    uint64_t overruns = 0;
+    uint64_t skipped_ticks = 0;
+    DAQ_Latency_Snapshot jitter;
+};
+
+class DAQ_Tick_Driver {
+
+public:
+    // The first deadline is one period from now
+    explicit DAQ_Tick_Driver(const std::chrono::nanoseconds period, const std::chrono::nanoseconds spin = std::chrono::nanoseconds(0)) :
+        _period_ns(std::max<uint64_t>(1, static_cast<uint64_t>(period.count()))), _spin_ns(static_cast<uint64_t>(spin.count())) {
+        _next_ns = _now_ns() + _period_ns;
+    };
+
+    // Blocks until the next deadline. Returns the number of ticks skipped because the previous one overran (0 in the normal case)
+    uint64_t wait_next_tick() {
+
+        uint64_t now = _now_ns();
+
+        if (now >= _next_ns) {
+            const uint64_t lateness = now - _next_ns;
+            const uint64_t skipped = lateness / _period_ns;
+            _overruns++;
+            _skipped_ticks += skipped;
+            _next_ns += (skipped + 1) * _period_ns;
+            _record_tick(lateness);
+            return skipped;
+        }
+
+        // Sleep through most of the wait, and only spin the last part
+        if (_next_ns - now > _spin_ns) {
+            const uint64_t wake_ns = _next_ns - _spin_ns;
+            const timespec wake {static_cast<time_t>(wake_ns / 1000000000ULL), static_cast<long>(wake_ns % 1000000000ULL)};
+            while (::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) == EINTR) {}
+            now = _now_ns();
+        }
+        while (now < _next_ns) {
+            now = _now_ns();
+        }
+
+        _record_tick(now - _next_ns);
+        _next_ns += _period_ns;
+        return 0;
+    }
+
+    DAQ_Tick_Statistics statistics() const {
+        DAQ_Tick_Statistics statistics;
+        statistics.ticks = _ticks;
+        statistics.overruns = _overruns;
+        statistics.skipped_ticks = _skipped_ticks;
+        _jitter.snapshot(statistics.jitter);
+        return statistics;
+    }
+
+    void log_statistics() const {
+        const DAQ_Tick_Statistics stats = statistics();
+        spdlog::info("Tick driver: {} ticks at {} ns, {} overruns, {} skipped, jitter p50 {} ns p99 {} ns p999 {} ns max {} ns",
+                     stats.ticks, _period_ns, stats.overruns, stats.skipped_ticks, stats.jitter.percentile_ns(0.50),
+                     stats.jitter.percentile_ns(0.99), stats.jitter.percentile_ns(0.999), stats.jitter.max_ns);
+    }
+
+    // Pins the calling thread to a single core, ideally one kept free of everything else with isolcpus
+    static bool pin_current_thread(const int core) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(core, &cpu_set);
+        const int result = ::pthread_setaffinity_np(::pthread_self(), sizeof(cpu_set), &cpu_set);
+        if (result != 0) {
+            spdlog::warn("Fails to pin the tick thread to core {}: {}", core, std::strerror(result));
+            return false;
+        }
+        return true;
+    }
+
+    // SCHED_FIFO, so nothing but higher priority real time threads can preempt the tick. Needs CAP_SYS_NICE (or an rtprio limit)
+    static bool set_realtime_priority(const int priority) {
+        sched_param parameters {};
+        parameters.sched_priority = priority;
+        const int result = ::pthread_setschedparam(::pthread_self(), SCHED_FIFO, &parameters);
+        if (result != 0) {
+            spdlog::warn("Fails to switch the tick thread to SCHED_FIFO {}: {}", priority, std::strerror(result));
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static uint64_t _now_ns() {
+        timespec now;
+        ::clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+    }
+
+    void _record_tick(const uint64_t jitter_ns) {
+        _ticks++;
+        _jitter.record(jitter_ns);
+    }
+
+    const uint64_t _period_ns;
+    const uint64_t _spin_ns;
+    uint64_t _next_ns;
+
+    uint64_t _ticks = 0;
+    uint64_t _overruns = 0;
+    uint64_t _skipped_ticks = 0;
+    DAQ_Latency_Histogram _jitter;
+};
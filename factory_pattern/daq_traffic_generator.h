@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#include "daq_mavlink_parser.h"
+
+/*
+ * Synthetic traffic for DAQ_Mode::SIMULATION.
+ *
+ * Generates the exact bytes a real sender would put on the wire (UDP datagrams of float samples or MAVLink v2 frames), so that the
+ * simulation exercises the same parsers as live data without any hardware or network in the loop.
+ *
+ * Everything is driven by a seeded xorshift generator, so two runs with the same configuration produce the same byte stream and the
+ * throughput numbers are reproducible.
+ */
+
+enum class DAQ_Traffic_Type {
+    UDP_SAMPLES = 0,
+    MAVLINK_ATTITUDE = 1,
+};
+
+struct DAQ_Traffic_Config {
+    DAQ_Traffic_Type type = DAQ_Traffic_Type::UDP_SAMPLES;
+    // Messages per second. 0 generates as many messages as the backend is allowed per update()
+    double messages_per_second = 1000.0;
+    // Size of a UDP datagram in bytes (rounded down to whole floats). MAVLink frames always carry an ATTITUDE message
+    size_t payload_size = 64;
+    // Messages are released in bursts of this many back to back messages. 1 means evenly spaced
+    size_t burst_size = 1;
+    // Probability that a message gets one byte flipped, to exercise the error paths of the parsers
+    double corruption_ratio = 0.0;
+    uint64_t seed = 1;
+};
+
+class DAQ_Traffic_Generator {
+
+public:
+    static constexpr size_t MAX_MESSAGE_SIZE = 1472;
+
+    explicit DAQ_Traffic_Generator(const DAQ_Traffic_Config &config) :
+        _config(config), _state(config.seed == 0 ? 1 : config.seed) {};
+
+    const DAQ_Traffic_Config &config() const { return _config; }
+
+    // Writes the next message into an internal buffer and returns a view of it, valid until the next call
+    std::span<const uint8_t> next_message() {
+
+        size_t length = 0;
+
+        switch (_config.type) {
+            case DAQ_Traffic_Type::UDP_SAMPLES: {
+                const size_t sample_count = std::min(_config.payload_size, MAX_MESSAGE_SIZE) / sizeof(float);
+                for (size_t i = 0; i < sample_count; i++) {
+                    const float sample = _next_float();
+                    std::memcpy(_buffer.data() + i * sizeof(float), &sample, sizeof(float));
+                }
+                length = sample_count * sizeof(float);
+                break;
+            }
+            case DAQ_Traffic_Type::MAVLINK_ATTITUDE: {
+                // ATTITUDE: time_boot_ms, roll, pitch, yaw, rollspeed, pitchspeed, yawspeed
+                uint8_t payload[28];
+                const uint32_t time_boot_ms = static_cast<uint32_t>(_sequence);
+                std::memcpy(payload, &time_boot_ms, sizeof(time_boot_ms));
+                for (size_t i = 0; i < 6; i++) {
+                    const float value = _next_float();
+                    std::memcpy(payload + sizeof(uint32_t) + i * sizeof(float), &value, sizeof(float));
+                }
+                length = mavlink_pack_frame(_buffer, static_cast<uint8_t>(_sequence), 1, 1, MAVLINK_MSG_ID_ATTITUDE, payload);
+                break;
+            }
+        }
+
+        if (length > 0 && _config.corruption_ratio > 0.0 && _next_unit() < _config.corruption_ratio) {
+            _buffer[_next() % length] ^= static_cast<uint8_t>(1 + _next() % 255);
+            _corrupted++;
+        }
+
+        _sequence++;
+        return std::span<const uint8_t>(_buffer.data(), length);
+    }
+
+    uint64_t generated() const { return _sequence; }
+    uint64_t corrupted() const { return _corrupted; }
+
+private:
+
+    // xorshift64*, good enough for test traffic and much cheaper than std::mt19937
+    uint64_t _next() {
+        _state ^= _state >> 12;
+        _state ^= _state << 25;
+        _state ^= _state >> 27;
+        return _state * 0x2545F4914F6CDD1DULL;
+    }
+
+    // Uniform in [0, 1)
+    double _next_unit() {
+        return static_cast<double>(_next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    float _next_float() {
+        return static_cast<float>(_next_unit() * 2.0 - 1.0);
+    }
+
+    DAQ_Traffic_Config _config;
+    uint64_t _state;
+    uint64_t _sequence = 0;
+    uint64_t _corrupted = 0;
+
+    std::array<uint8_t, MAX_MESSAGE_SIZE> _buffer {};
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+
+#include <spdlog/spdlog.h>
+
+#include "daq_log.h"
+
+/*
+ * Non-blocking UDP socket that receives datagrams in batches.
+ *
+ * Calling recvfrom() once per datagram means one syscall per packet, which at high packet rates costs more than the parsing itself.
+ * recvmmsg() lets the kernel fill up to BATCH_SIZE datagrams in a single syscall. All of the buffers (and the iovec/mmsghdr
+ * descriptors pointing at them) are allocated once with the socket, so receiving never allocates.
+ *
+ * The received datagrams are exposed as spans pointing straight into those buffers. They stay valid until the next call to
+ * receive_batch(), so the parser has to be done with them by then (or copy what it wants to keep). Neither parser keeps a datagram
+ * past its call, so the slots are a plain array rather than buffers from a DAQ_Buffer_Pool that would only ever sit in place.
+ */
+class DAQ_UDP_Socket {
+
+public:
+    static constexpr size_t BATCH_SIZE = 32;
+    // Largest payload of a UDP datagram over IPv4
+    static constexpr size_t MAX_DATAGRAM_SIZE = 65507;
+
+    using Packet = std::span<const uint8_t>;
+
+    DAQ_UDP_Socket() = default;
+    ~DAQ_UDP_Socket() { close(); }
+
+    DAQ_UDP_Socket(const DAQ_UDP_Socket &) = delete;
+    DAQ_UDP_Socket &operator=(const DAQ_UDP_Socket &) = delete;
+
+    // Binds to the given IPv4 address and port. Use port 0 to let the kernel pick one (see local_port())
+    bool open(const char *bind_address, const uint16_t port, const size_t max_datagram_size = 2048) {
+
+        _fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_fd < 0) {
+            spdlog::error("Fails to create UDP socket: {}", std::strerror(errno));
+            return false;
+        }
+
+        sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        if (::inet_pton(AF_INET, bind_address, &address.sin_addr) != 1) {
+            spdlog::error("Invalid bind address {}", bind_address);
+            close();
+            return false;
+        }
+
+        if (::bind(_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+            spdlog::error("Fails to bind UDP socket to {}:{}: {}", bind_address, port, std::strerror(errno));
+            close();
+            return false;
+        }
+
+        _buffer_size = std::min(max_datagram_size, MAX_DATAGRAM_SIZE);
+        _storage = std::make_unique<uint8_t[]>(_buffer_size * BATCH_SIZE);
+
+        for (size_t i = 0; i < BATCH_SIZE; i++) {
+            _iovecs[i].iov_base = _storage.get() + i * _buffer_size;
+            _iovecs[i].iov_len = _buffer_size;
+            _messages[i].msg_hdr = {};
+            _messages[i].msg_hdr.msg_iov = &_iovecs[i];
+            _messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        return true;
+    }
+
+    void close() {
+        if (_fd >= 0) {
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+
+    bool is_open() const { return _fd >= 0; }
+    int fd() const { return _fd; }
+
+    uint16_t local_port() const {
+        sockaddr_in address {};
+        socklen_t length = sizeof(address);
+        if (::getsockname(_fd, reinterpret_cast<sockaddr *>(&address), &length) < 0) {
+            return 0;
+        }
+        return ntohs(address.sin_port);
+    }
+
+    // Receives up to max_packets datagrams with a single syscall. Returns the packets received, or an empty span if the socket
+    // had nothing to read. A datagram larger than the receive buffers only arrives as its first bytes (MSG_TRUNC): it is dropped
+    // rather than handed to a parser as a partial frame, and counted in truncated().
+    std::span<const Packet> receive_batch(const size_t max_packets = BATCH_SIZE) {
+
+        const unsigned int vlen = static_cast<unsigned int>(std::min(max_packets, BATCH_SIZE));
+        const int received = ::recvmmsg(_fd, _messages.data(), vlen, MSG_DONTWAIT, nullptr);
+
+        if (received < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                DAQ_LOG_WARN("recvmmsg failed with errno {}", errno);
+            }
+            return {};
+        }
+
+        size_t packets = 0;
+        for (int i = 0; i < received; i++) {
+            if (_messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                _truncated++;
+                continue;
+            }
+            _packets[packets++] = Packet(static_cast<const uint8_t *>(_iovecs[i].iov_base), _messages[i].msg_len);
+        }
+
+        return std::span<const Packet>(_packets.data(), packets);
+    }
+
+    // Datagrams dropped by receive_batch() because they did not fit in the receive buffers, since the socket was created
+    size_t truncated() const { return _truncated; }
+
+    ssize_t send_to(const char *address, const uint16_t port, std::span<const uint8_t> data) {
+        sockaddr_in destination {};
+        destination.sin_family = AF_INET;
+        destination.sin_port = htons(port);
+        ::inet_pton(AF_INET, address, &destination.sin_addr);
+        return ::sendto(_fd, data.data(), data.size(), MSG_DONTWAIT,
+                        reinterpret_cast<sockaddr *>(&destination), sizeof(destination));
+    }
+
+private:
+    int _fd = -1;
+    size_t _buffer_size = 0;
+    size_t _truncated = 0;
+
+    std::unique_ptr<uint8_t[]> _storage;
+    std::array<iovec, BATCH_SIZE> _iovecs {};
+    std::array<mmsghdr, BATCH_SIZE> _messages {};
+    std::array<Packet, BATCH_SIZE> _packets {};
+};
@@ -0,0 +1,34 @@
+#include <cmath>
+
+#include "daq_backend_registry.h"
+
+/*
+ * Example of a backend that lives outside of the core, in a shared library loaded at startup:
+ *   advanced_factory_pattern --plugin ./libdaq_counter_plugin.so --backends counter,udp
+ *
+ * A site specific protocol would look exactly the same: derive from DAQ_Backend, implement the interface, and register a constructor
+ * from daq_register_backends(). Nothing in DAQ_App has to be recompiled.
+ */
+class DAQ_Counter final : public DAQ_Backend {
+
+public:
+    void setup() override {};
+
+    bool init() override {
+        DAQ_LOG_INFO("{} init() function. Nothing to open, the samples are generated.", protocol_type());
+        return true;
+    }
+
+    // Publishes a slow sine wave, one sample per update()
+    void update() override {
+        _metrics->add_messages(1, sizeof(float));
+        publish_sample(static_cast<float>(std::sin(0.1 * static_cast<double>(_metrics->messages()))));
+    }
+
+    const char *protocol_type() const override { return "Counter"; }
+};
+
+extern "C" void daq_register_backends(DAQ_Backend_Registry &registry) {
+    registry.register_backend("counter", DAQ_Protocol::INVALID,
+                              []() -> std::unique_ptr<DAQ_Backend> { return std::make_unique<DAQ_Counter>(); });
+}
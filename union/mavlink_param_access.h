@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+
+#include "mavlink_param_union.h"
+
+/*
+ * Type safe access to the value of a mavlink_param_union_t.
+ *
+ * Writing one member of a union and reading another (type punning) is what C does all the time, and what the first half of
+ * union_example.cpp shows. In C++ it is undefined behaviour: only the member written last is alive. GCC happens to allow it, but the
+ * optimizer is entitled to assume it never happens, and under LTO it can see enough of the program to act on that.
+ *
+ * The defined way to reinterpret bits is to copy the object representation, which is what std::bit_cast (and memcpy) does. So the
+ * accessors never read a member, they copy the whole 4 bytes out and bit_cast those:
+ *
+ *   mavlink_param_union_t --copy--> 4 bytes (wire order) --little endian--> uint32_t --bit_cast/truncate--> T
+ *
+ * Every step compiles away on the little endian targets MAVLink runs on (a load of the right width, vectorised like the raw member
+ * access would be), see union_bench. Everything but the conversion from and to the union itself is constexpr.
+ *
+ * MAVLink puts the bytes of the union on the wire in memory order, and the narrower types sit in the first bytes (bytes[0] for a
+ * uint8). Mavlink_Param_Value keeps that explicit: its raw() value is the 4 wire bytes read as little endian, whatever the host, and
+ * bytes_le()/bytes_be() give the byte views without ever touching the bytes[4] member.
+ *
+ * get<T>() and set<T>() only exist for the types a parameter can have, the MAV_PARAM_TYPE tag of which is mavlink_param_type_v<T>.
+ */
+
+template <typename T>
+concept Mavlink_Param_Scalar = std::same_as<T, uint8_t> || std::same_as<T, int8_t> || std::same_as<T, uint16_t> ||
+                               std::same_as<T, int16_t> || std::same_as<T, uint32_t> || std::same_as<T, int32_t> ||
+                               std::same_as<T, float>;
+
+// The MAV_PARAM_TYPE tag of each C++ type, resolved at compile time
+template <Mavlink_Param_Scalar T>
+inline constexpr MAV_PARAM_TYPE mavlink_param_type_v =
+    std::same_as<T, uint8_t> ? MAV_PARAM_TYPE_UINT8 :
+    std::same_as<T, int8_t> ? MAV_PARAM_TYPE_INT8 :
+    std::same_as<T, uint16_t> ? MAV_PARAM_TYPE_UINT16 :
+    std::same_as<T, int16_t> ? MAV_PARAM_TYPE_INT16 :
+    std::same_as<T, uint32_t> ? MAV_PARAM_TYPE_UINT32 :
+    std::same_as<T, int32_t> ? MAV_PARAM_TYPE_INT32 : MAV_PARAM_TYPE_REAL32;
+
+class Mavlink_Param_Value {
+
+public:
+    constexpr Mavlink_Param_Value() = default;
+
+    template <Mavlink_Param_Scalar T>
+    static constexpr Mavlink_Param_Value of(const T value) {
+        Mavlink_Param_Value result;
+        result.set<T>(value);
+        return result;
+    }
+
+    // Reads the first sizeof(T) bytes as T. Defined whatever type was set last, it reinterprets the bits
+    template <Mavlink_Param_Scalar T>
+    constexpr T get() const {
+        if constexpr (sizeof(T) == 1) {
+            return std::bit_cast<T>(static_cast<uint8_t>(_raw));
+        } else if constexpr (sizeof(T) == 2) {
+            return std::bit_cast<T>(static_cast<uint16_t>(_raw));
+        } else {
+            return std::bit_cast<T>(_raw);
+        }
+    }
+
+    // Only if the value was declared with T, for handling a PARAM_SET or PARAM_VALUE that carries its own type
+    template <Mavlink_Param_Scalar T>
+    constexpr std::optional<T> get_if(const uint8_t type) const {
+        if (type != mavlink_param_type_v<T>) {
+            return std::nullopt;
+        }
+        return get<T>();
+    }
+
+    // Stores value in the first sizeof(T) bytes, the others are zeroed (like MAVLink does for the narrower types)
+    template <Mavlink_Param_Scalar T>
+    constexpr void set(const T value) {
+        if constexpr (sizeof(T) == 1) {
+            _raw = std::bit_cast<uint8_t>(value);
+        } else if constexpr (sizeof(T) == 2) {
+            _raw = std::bit_cast<uint16_t>(value);
+        } else {
+            _raw = std::bit_cast<uint32_t>(value);
+        }
+    }
+
+    // The 4 wire bytes read as a little endian integer
+    constexpr uint32_t raw() const { return _raw; }
+
+    // bytes[0] first, the order of the union in memory and on the wire
+    constexpr std::array<uint8_t, 4> bytes_le() const {
+        return {static_cast<uint8_t>(_raw), static_cast<uint8_t>(_raw >> 8), static_cast<uint8_t>(_raw >> 16),
+                static_cast<uint8_t>(_raw >> 24)};
+    }
+    // Most significant byte first, for printing or for a big endian peer
+    constexpr std::array<uint8_t, 4> bytes_be() const {
+        return {static_cast<uint8_t>(_raw >> 24), static_cast<uint8_t>(_raw >> 16), static_cast<uint8_t>(_raw >> 8),
+                static_cast<uint8_t>(_raw)};
+    }
+
+    static constexpr Mavlink_Param_Value from_bytes_le(const std::array<uint8_t, 4> bytes) {
+        Mavlink_Param_Value result;
+        result._raw = static_cast<uint32_t>(bytes[0]) | static_cast<uint32_t>(bytes[1]) << 8 |
+                      static_cast<uint32_t>(bytes[2]) << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+        return result;
+    }
+
+    // A union can not be copied bit for bit at compile time, so these two only run at run time. On a little endian host the memory
+    // order already is the wire order and the 4 bytes are copied as a whole. That copy is a memcpy rather than a std::bit_cast of the
+    // union: both are defined behaviour, but GCC only vectorises loops over the former. The byte by byte path is for the other hosts
+    static Mavlink_Param_Value from_union(const mavlink_param_union_t &value) {
+        if constexpr (std::endian::native == std::endian::little) {
+            Mavlink_Param_Value result;
+            std::memcpy(&result._raw, &value, sizeof(result._raw));
+            return result;
+        } else {
+            return from_bytes_le(std::bit_cast<std::array<uint8_t, 4>>(value));
+        }
+    }
+    mavlink_param_union_t to_union() const {
+        mavlink_param_union_t value;
+        if constexpr (std::endian::native == std::endian::little) {
+            std::memcpy(&value, &_raw, sizeof(_raw));
+        } else {
+            const std::array<uint8_t, 4> bytes = bytes_le();
+            std::memcpy(&value, bytes.data(), bytes.size());
+        }
+        return value;
+    }
+
+    constexpr bool operator==(const Mavlink_Param_Value &other) const = default;
+
+private:
+    uint32_t _raw = 0;
+};
+
+static_assert(sizeof(mavlink_param_union_t) == 4, "The accessors assume the 4 byte MAVLink param union");
+static_assert(std::is_trivially_copyable_v<mavlink_param_union_t>, "Copying the bits out needs a trivially copyable union");
+
+// Same accessors straight on the union, for code that keeps mavlink_param_union_t around (e.g. Mavlink_Param_Store)
+template <Mavlink_Param_Scalar T>
+inline T mavlink_param_get(const mavlink_param_union_t &value) {
+    return Mavlink_Param_Value::from_union(value).get<T>();
+}
+
+template <Mavlink_Param_Scalar T>
+inline void mavlink_param_set(mavlink_param_union_t &value, const T new_value) {
+    value = Mavlink_Param_Value::of(new_value).to_union();
+}
+
+// Compile time checks of the byte layout, these are what would silently go wrong on a big endian port
+static_assert(Mavlink_Param_Value::of<uint8_t>(0xAB).bytes_le() == std::array<uint8_t, 4> {0xAB, 0, 0, 0});
+static_assert(Mavlink_Param_Value::of<int16_t>(-2).get<uint16_t>() == 0xFFFE);
+static_assert(Mavlink_Param_Value::of<float>(1.0f).bytes_be() == std::array<uint8_t, 4> {0x3F, 0x80, 0, 0});
+static_assert(Mavlink_Param_Value::from_bytes_le({0x01, 0x02, 0x03, 0x04}).raw() == 0x04030201);
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MAVLINK_PARAM_CONVERT_X86
+#endif
+
+#include "mavlink_param_access.h"
+#include "mavlink_param_union.h"
+
+/*
+ * Bulk conversion between mavlink_param_union_t and double.
+ *
+ * A parameter dump is an array of 4 byte unions plus an array of MAV_PARAM_TYPE tags telling which member of each union is valid.
+ * Turning it into plain numbers one parameter at a time means a switch per value, and with the types mixed at random the branch
+ * predictor gets about every other one wrong. The AVX2 version does not branch on the type at all: it decodes 8 values at once as
+ * every type they could be, and keeps the right one per lane:
+ *
+ *   raw bits ---shift left, shift right (arithmetic if signed)---> sign/zero extended integer -> double
+ *            ---widen float---------------------------------------> double
+ *   types ----table lookup (shuffle)----> shift amount, signedness per lane --> blend masks
+ *
+ * so the loop runs at the speed memory can feed it.
+ *
+ * Types that do not fit the union (the 64 bit ones) decode to NaN and encode to 0. Encoding rounds to the nearest integer (ties to
+ * even) and saturates to the range of the type, NaN encodes to 0 for the integer types.
+ *
+ * The AVX2 versions are compiled with a target attribute, so the rest of the program does not need -mavx2, and the
+ * mavlink_param_decode()/mavlink_param_encode() entry points pick them at run time if the CPU has AVX2. Both produce exactly the same
+ * results as the scalar versions, which are also the fallback everywhere else. union_bench checks that (every type tag, ties, limits,
+ * infinities, NaN) before it measures anything, and fails if a single value differs.
+ */
+
+// One value
+inline double mavlink_param_to_double(const mavlink_param_union_t value, const uint8_t type) {
+    const Mavlink_Param_Value bits = Mavlink_Param_Value::from_union(value);
+    switch (type) {
+        case MAV_PARAM_TYPE_UINT8: return bits.get<uint8_t>();
+        case MAV_PARAM_TYPE_INT8: return bits.get<int8_t>();
+        case MAV_PARAM_TYPE_UINT16: return bits.get<uint16_t>();
+        case MAV_PARAM_TYPE_INT16: return bits.get<int16_t>();
+        case MAV_PARAM_TYPE_UINT32: return bits.get<uint32_t>();
+        case MAV_PARAM_TYPE_INT32: return bits.get<int32_t>();
+        case MAV_PARAM_TYPE_REAL32: return bits.get<float>();
+        default: return std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+inline mavlink_param_union_t mavlink_param_from_double(const double value, const uint8_t type) {
+
+    Mavlink_Param_Value result;
+
+    if (type == MAV_PARAM_TYPE_REAL32) {
+        result.set<float>(static_cast<float>(value));
+        return result.to_union();
+    }
+
+    double low;
+    double high;
+    switch (type) {
+        case MAV_PARAM_TYPE_UINT8: low = 0.0; high = UINT8_MAX; break;
+        case MAV_PARAM_TYPE_INT8: low = INT8_MIN; high = INT8_MAX; break;
+        case MAV_PARAM_TYPE_UINT16: low = 0.0; high = UINT16_MAX; break;
+        case MAV_PARAM_TYPE_INT16: low = INT16_MIN; high = INT16_MAX; break;
+        case MAV_PARAM_TYPE_UINT32: low = 0.0; high = UINT32_MAX; break;
+        case MAV_PARAM_TYPE_INT32: low = INT32_MIN; high = INT32_MAX; break;
+        default: return result.to_union();
+    }
+    if (std::isnan(value)) {
+        return result.to_union();
+    }
+
+    const double clamped = std::fmin(std::fmax(std::nearbyint(value), low), high);
+    switch (type) {
+        case MAV_PARAM_TYPE_UINT8: result.set<uint8_t>(static_cast<uint8_t>(clamped)); break;
+        case MAV_PARAM_TYPE_INT8: result.set<int8_t>(static_cast<int8_t>(clamped)); break;
+        case MAV_PARAM_TYPE_UINT16: result.set<uint16_t>(static_cast<uint16_t>(clamped)); break;
+        case MAV_PARAM_TYPE_INT16: result.set<int16_t>(static_cast<int16_t>(clamped)); break;
+        case MAV_PARAM_TYPE_UINT32: result.set<uint32_t>(static_cast<uint32_t>(clamped)); break;
+        case MAV_PARAM_TYPE_INT32: result.set<int32_t>(static_cast<int32_t>(clamped)); break;
+        default: break;
+    }
+    return result.to_union();
+}
+
+inline void mavlink_param_decode_scalar(const mavlink_param_union_t *values, const uint8_t *types, const size_t count,
+                                        double *out) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = mavlink_param_to_double(values[i], types[i]);
+    }
+}
+
+inline void mavlink_param_encode_scalar(const double *values, const uint8_t *types, const size_t count,
+                                        mavlink_param_union_t *out) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = mavlink_param_from_double(values[i], types[i]);
+    }
+}
+
+#ifdef MAVLINK_PARAM_CONVERT_X86
+
+// Per type tables, indexed by MAV_PARAM_TYPE (16 entries so a byte shuffle can look them up)
+namespace mavlink_param_convert_tables {
+    // 32 - width of the integer types, shifting left then right by this sign or zero extends
+    alignas(16) constexpr uint8_t SHIFT[16] = {0, 24, 24, 16, 16, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    // 0xFF for the signed types
+    alignas(16) constexpr uint8_t SIGNED[16] = {0, 0, 0xFF, 0, 0xFF, 0, 0xFF, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    // 0xFF for the integer types that fit the union
+    alignas(16) constexpr uint8_t INTEGER[16] = {0, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    // Ranges for saturating, gathered per lane when encoding
+    constexpr double LOW[16] = {0, 0, INT8_MIN, 0, INT16_MIN, 0, INT32_MIN, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    constexpr double HIGH[16] = {0, UINT8_MAX, INT8_MAX, UINT16_MAX, INT16_MAX, UINT32_MAX, INT32_MAX, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+}
+
+// Looks up a 16 entry byte table for every 32 bit lane holding a type. Types above 15 (not a MAV_PARAM_TYPE anyway) read entry 0
+__attribute__((target("avx2"))) inline __m256i mavlink_param_lookup(const uint8_t *table, const __m256i types) {
+    const __m256i lut = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(table)));
+    const __m256i index = _mm256_andnot_si256(_mm256_cmpgt_epi32(types, _mm256_set1_epi32(15)), types);
+    return _mm256_and_si256(_mm256_shuffle_epi8(lut, index), _mm256_set1_epi32(0xFF));
+}
+
+// Picks and widens 4 decoded lanes into 4 doubles. The masks are 32 bits per lane and widened to 64 by sign extension
+__attribute__((target("avx2"))) inline void mavlink_param_decode_half(const __m128i raw, const __m128i integer, const __m128i needs_wrap,
+                                                                      const __m128i is_integer, const __m128i is_float, double *out) {
+    const __m256d nan = _mm256_set1_pd(std::numeric_limits<double>::quiet_NaN());
+    const __m256d two_pow_32 = _mm256_set1_pd(4294967296.0);
+
+    __m256d as_integer = _mm256_cvtepi32_pd(integer);
+    as_integer = _mm256_add_pd(as_integer, _mm256_and_pd(_mm256_castsi256_pd(_mm256_cvtepi32_epi64(needs_wrap)), two_pow_32));
+    const __m256d as_float = _mm256_cvtps_pd(_mm_castsi128_ps(raw));
+
+    __m256d result = _mm256_blendv_pd(nan, as_integer, _mm256_castsi256_pd(_mm256_cvtepi32_epi64(is_integer)));
+    result = _mm256_blendv_pd(result, as_float, _mm256_castsi256_pd(_mm256_cvtepi32_epi64(is_float)));
+    _mm256_storeu_pd(out, result);
+}
+
+__attribute__((target("avx2"))) inline void mavlink_param_decode_avx2(const mavlink_param_union_t *values, const uint8_t *types,
+                                                                      const size_t count, double *out) {
+    namespace tables = mavlink_param_convert_tables;
+
+    const __m256i real32 = _mm256_set1_epi32(MAV_PARAM_TYPE_REAL32);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+
+        const __m256i raw = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+        const __m256i type = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(types + i)));
+
+        const __m256i shift = mavlink_param_lookup(tables::SHIFT, type);
+        const __m256i is_signed = _mm256_cmpeq_epi32(mavlink_param_lookup(tables::SIGNED, type), _mm256_set1_epi32(0xFF));
+        const __m256i is_integer = _mm256_cmpeq_epi32(mavlink_param_lookup(tables::INTEGER, type), _mm256_set1_epi32(0xFF));
+        const __m256i is_float = _mm256_cmpeq_epi32(type, real32);
+
+        const __m256i shifted = _mm256_sllv_epi32(raw, shift);
+        const __m256i integer = _mm256_blendv_epi8(_mm256_srlv_epi32(shifted, shift), _mm256_srav_epi32(shifted, shift), is_signed);
+        // UINT32 values with the top bit set come out of the signed conversion 2^32 too small. The narrower unsigned types were zero
+        // extended, so UINT32 is the only unsigned type that can look negative here
+        const __m256i needs_wrap = _mm256_andnot_si256(is_signed, _mm256_cmpgt_epi32(_mm256_setzero_si256(), integer));
+
+        // 8 lanes of 32 bits become 2 x 4 lanes of 64 bits
+        mavlink_param_decode_half(_mm256_castsi256_si128(raw), _mm256_castsi256_si128(integer), _mm256_castsi256_si128(needs_wrap),
+                                  _mm256_castsi256_si128(is_integer), _mm256_castsi256_si128(is_float), out + i);
+        mavlink_param_decode_half(_mm256_extracti128_si256(raw, 1), _mm256_extracti128_si256(integer, 1),
+                                  _mm256_extracti128_si256(needs_wrap, 1), _mm256_extracti128_si256(is_integer, 1),
+                                  _mm256_extracti128_si256(is_float, 1), out + i + 4);
+    }
+
+    mavlink_param_decode_scalar(values + i, types + i, count - i, out + i);
+}
+
+__attribute__((target("avx2"))) inline void mavlink_param_encode_avx2(const double *values, const uint8_t *types, const size_t count,
+                                                                      mavlink_param_union_t *out) {
+    namespace tables = mavlink_param_convert_tables;
+
+    const __m128i real32 = _mm_set1_epi32(MAV_PARAM_TYPE_REAL32);
+    const __m256d two_pow_31 = _mm256_set1_pd(2147483648.0);
+    const __m256d two_pow_32 = _mm256_set1_pd(4294967296.0);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+
+        const __m256d value = _mm256_loadu_pd(values + i);
+        int32_t type_bytes;
+        std::memcpy(&type_bytes, types + i, sizeof(type_bytes));
+        const __m128i type = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(type_bytes));
+        // The byte table lookup works on 8 lanes, only the low 4 are used here
+        const __m256i type8 = _mm256_inserti128_si256(_mm256_setzero_si256(), type, 0);
+        const __m128i shift = _mm256_castsi256_si128(mavlink_param_lookup(tables::SHIFT, type8));
+        const __m128i is_integer = _mm_cmpeq_epi32(_mm256_castsi256_si128(mavlink_param_lookup(tables::INTEGER, type8)),
+                                                   _mm_set1_epi32(0xFF));
+        const __m128i is_float = _mm_cmpeq_epi32(type, real32);
+
+        // Saturate to the range of each lane's type, gathered from the tables (types above 15 are cut to 0 first)
+        const __m128i index = _mm_andnot_si128(_mm_cmpgt_epi32(type, _mm_set1_epi32(15)), type);
+        // The masked form with every lane enabled, the plain one trips -Wmaybe-uninitialized inside the GCC headers
+        const __m256d all_lanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        const __m256d low = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), tables::LOW, index, all_lanes, 8);
+        const __m256d high = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), tables::HIGH, index, all_lanes, 8);
+        const __m256d rounded = _mm256_round_pd(value, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256d clamped = _mm256_min_pd(_mm256_max_pd(rounded, low), high);
+        // max/min would let NaN through as the range bound, the scalar version encodes it as 0
+        clamped = _mm256_andnot_pd(_mm256_cmp_pd(value, value, _CMP_UNORD_Q), clamped);
+        // Above INT32_MAX only happens for UINT32, wrap so the signed conversion yields the same bits
+        clamped = _mm256_sub_pd(clamped, _mm256_and_pd(_mm256_cmp_pd(clamped, two_pow_31, _CMP_GE_OQ), two_pow_32));
+
+        // Only the bytes of the type's width are kept, like assigning the member of a zeroed union
+        __m128i integer = _mm256_cvtpd_epi32(clamped);
+        integer = _mm_srlv_epi32(_mm_sllv_epi32(integer, shift), shift);
+        integer = _mm_and_si128(integer, is_integer);
+
+        const __m128i as_float = _mm_castps_si128(_mm256_cvtpd_ps(value));
+        const __m128i result = _mm_blendv_epi8(integer, as_float, is_float);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), result);
+    }
+
+    mavlink_param_encode_scalar(values + i, types + i, count - i, out + i);
+}
+
+#endif // MAVLINK_PARAM_CONVERT_X86
+
+// Decodes count values into out, with AVX2 if the CPU has it
+inline void mavlink_param_decode(const mavlink_param_union_t *values, const uint8_t *types, const size_t count, double *out) {
+#ifdef MAVLINK_PARAM_CONVERT_X86
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) {
+        mavlink_param_decode_avx2(values, types, count, out);
+        return;
+    }
+#endif
+    mavlink_param_decode_scalar(values, types, count, out);
+}
+
+// Encodes count values into out, with AVX2 if the CPU has it
+inline void mavlink_param_encode(const double *values, const uint8_t *types, const size_t count, mavlink_param_union_t *out) {
+#ifdef MAVLINK_PARAM_CONVERT_X86
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) {
+        mavlink_param_encode_avx2(values, types, count, out);
+        return;
+    }
+#endif
+    mavlink_param_encode_scalar(values, types, count, out);
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "mavlink_param_union.h"
+
+/*
+ * Parameter table of a MAVLink component, built on mavlink_param_union_t.
+ *
+ * Every parameter is identified by a param_id of at most 16 characters (not null terminated when it is exactly 16 long), and the
+ * protocol also refers to it by index: PARAM_REQUEST_LIST walks every index from 0 to param_count - 1, PARAM_REQUEST_READ may ask
+ * for either, and PARAM_SET only gives the id. An autopilot easily has a thousand parameters, so both lookups have to be O(1).
+ *
+ * The table therefore keeps two things:
+ *   * the parameters themselves, in a flat array. A parameter's position in that array is its index, and since parameters are
+ *     never removed, that index is stable for the lifetime of the table, which is exactly what PARAM_VALUE.param_index needs
+ *   * an open addressing hash table (linear probing) mapping an id to that index. Kept at most half full, a lookup probes about
+ *     1.5 slots on average (2.5 for an unknown id) whatever the size of the table, and the probed slots are next to each other. A
+ *     slot only holds a 16 bit index, so the table costs 4 bytes per parameter of capacity (256 KiB at MAX_PARAMS)
+ *
+ * Ids are stored as they are on the wire, 16 zero padded bytes, so hashing and comparing them is two 64 bit loads each and nothing is
+ * ever allocated: not when adding a parameter, not when looking one up, not when handling a PARAM_SET.
+ *
+ * The table also tracks what changed, so a periodic broadcast can send only the deltas. Every add() and every set() that changes a
+ * value bumps version() and stamps the parameter with it. A subscriber keeps the version it has seen last and asks for everything
+ * newer with for_each_changed(), as many subscribers as needed, each with its own version. To not look at every parameter for that:
+ *
+ *   versions:        per parameter, the version of its last change
+ *   block versions:  per block of 64 parameters, the newest version in it. Blocks nothing changed in since are skipped with one compare
+ *   dirty bitset:    for the blocks that did change, a 64 bit mask of the parameters newer than the subscriber's version, built in one
+ *                    branchless pass over the block and walked with countr_zero
+ *
+ * so pulling a few changes out of thousands of parameters costs about a compare per 64 of them.
+ */
+
+constexpr size_t MAVLINK_PARAM_ID_LEN = 16;
+
+// A param_id exactly as it travels on the wire
+struct Mavlink_Param_Id {
+    char chars[MAVLINK_PARAM_ID_LEN] = {};
+
+    Mavlink_Param_Id() = default;
+
+    // Anything past 16 characters is cut, like MAVLink would
+    Mavlink_Param_Id(std::string_view name) {
+        std::memcpy(chars, name.data(), name.size() < MAVLINK_PARAM_ID_LEN ? name.size() : MAVLINK_PARAM_ID_LEN);
+    }
+    Mavlink_Param_Id(const char *name) : Mavlink_Param_Id(std::string_view(name)) {}
+
+    // The param_id field of a received message
+    static Mavlink_Param_Id from_wire(const char *wire) {
+        Mavlink_Param_Id id;
+        std::memcpy(id.chars, wire, MAVLINK_PARAM_ID_LEN);
+        // Everything after the first null is padding, whatever the sender left in it
+        const size_t length = id.length();
+        std::memset(id.chars + length, 0, MAVLINK_PARAM_ID_LEN - length);
+        return id;
+    }
+
+    size_t length() const {
+        size_t length = 0;
+        while (length < MAVLINK_PARAM_ID_LEN && chars[length] != '\0') {
+            length++;
+        }
+        return length;
+    }
+
+    std::string_view view() const { return std::string_view(chars, length()); }
+
+    bool operator==(const Mavlink_Param_Id &other) const { return std::memcmp(chars, other.chars, MAVLINK_PARAM_ID_LEN) == 0; }
+    bool operator!=(const Mavlink_Param_Id &other) const { return !(*this == other); }
+
+    uint64_t hash() const {
+        uint64_t low;
+        uint64_t high;
+        std::memcpy(&low, chars, sizeof(low));
+        std::memcpy(&high, chars + sizeof(low), sizeof(high));
+        // Multiply and fold, enough to spread ids that only differ in their last characters (e.g. SERVO1_MIN, SERVO2_MIN)
+        uint64_t hash = low * 0x9E3779B97F4A7C15ULL ^ (high + 0x632BE59BD9B4E019ULL) * 0xC2B2AE3D27D4EB4FULL;
+        hash ^= hash >> 29;
+        hash *= 0xBF58476D1CE4E5B9ULL;
+        return hash ^ (hash >> 32);
+    }
+};
+
+static_assert(sizeof(Mavlink_Param_Id) == MAVLINK_PARAM_ID_LEN, "The id has to stay the exact wire representation");
+
+struct Mavlink_Param {
+    Mavlink_Param_Id id;
+    mavlink_param_union_t value;
+    MAV_PARAM_TYPE type;
+};
+
+class Mavlink_Param_Store {
+
+public:
+    // PARAM_VALUE.param_index and param_count are 16 bit, and one value is kept aside to mark empty slots
+    static constexpr size_t MAX_PARAMS = UINT16_MAX;
+    static constexpr int32_t NOT_FOUND = -1;
+    // set() with a type other than the one the parameter was declared with
+    static constexpr int32_t TYPE_MISMATCH = -2;
+
+    // Everything is allocated here, for at most capacity parameters
+    explicit Mavlink_Param_Store(size_t capacity) {
+        if (capacity > MAX_PARAMS) {
+            capacity = MAX_PARAMS;
+        }
+        _params.reserve(capacity);
+        _versions.reserve(capacity);
+        _block_versions.assign((capacity + BLOCK_SIZE - 1) / BLOCK_SIZE, 0);
+        _capacity = capacity;
+
+        // At most half full, so probe sequences stay short
+        size_t slots = 16;
+        while (slots < capacity * 2) {
+            slots *= 2;
+        }
+        _slots.assign(slots, EMPTY_SLOT);
+        _mask = slots - 1;
+    }
+
+    // Returns the index of the new parameter, or NOT_FOUND if the id is already taken or the table is full
+    int32_t add(const Mavlink_Param_Id &id, const MAV_PARAM_TYPE type, const mavlink_param_union_t value) {
+
+        size_t slot = _find_slot(id);
+        if (_slots[slot] != EMPTY_SLOT || _params.size() >= _capacity) {
+            return NOT_FOUND;
+        }
+
+        const uint16_t index = static_cast<uint16_t>(_params.size());
+        _params.push_back({id, value, type});
+        _versions.push_back(0);
+        _slots[slot] = index;
+        _mark_changed(index);
+        return index;
+    }
+
+    // Index of the parameter, or NOT_FOUND
+    int32_t find(const Mavlink_Param_Id &id) const {
+        const uint16_t index = _slots[_find_slot(id)];
+        return index == EMPTY_SLOT ? NOT_FOUND : index;
+    }
+
+    // PARAM_SET: the new value has to come with the type the parameter was declared with, otherwise the bytes of the union would be
+    // read as the wrong member. Returns the index of the parameter, NOT_FOUND if the id is unknown or TYPE_MISMATCH if the type does
+    // not match, so a PARAM_SET handler can tell a typo in the id from a client using the wrong type. Setting the value a parameter
+    // already has is not a change, subscribers will not see it again
+    int32_t set(const Mavlink_Param_Id &id, const MAV_PARAM_TYPE type, const mavlink_param_union_t value) {
+        const int32_t index = find(id);
+        if (index == NOT_FOUND) {
+            return NOT_FOUND;
+        }
+        if (_params[index].type != type) {
+            return TYPE_MISMATCH;
+        }
+        if (std::memcmp(&_params[index].value, &value, sizeof(value)) != 0) {
+            _params[index].value = value;
+            _mark_changed(static_cast<size_t>(index));
+        }
+        return index;
+    }
+
+    // index has to be below size(). This is how PARAM_REQUEST_LIST walks the table
+    const Mavlink_Param &get(const size_t index) const { return _params[index]; }
+
+    size_t size() const { return _params.size(); }
+    size_t capacity() const { return _capacity; }
+
+    // Version of the last change to the table, 0 for an empty one. A subscriber that has seen everything up to this version asks
+    // for_each_changed(version) next time
+    uint64_t version() const { return _version; }
+    // Version of the last change to the parameter at index
+    uint64_t version(const size_t index) const { return _versions[index]; }
+
+    // Calls on_changed(size_t index, const Mavlink_Param &) for every parameter added or changed after version since, in index order,
+    // starting at index first. on_changed returns false to stop early (e.g. when a send batch is full), and the returned index is
+    // where to pick up again, size() once all of them were visited. Pass since = 0 to get every parameter.
+    template <typename Callback>
+    size_t for_each_changed(const uint64_t since, Callback &&on_changed, const size_t first = 0) const {
+
+        for (size_t block = first / BLOCK_SIZE; block * BLOCK_SIZE < _params.size(); block++) {
+            if (_block_versions[block] <= since) {
+                continue;
+            }
+            uint64_t dirty = _changed_mask(block, since);
+            // Bits below first are the ones the previous call already went through
+            if (block == first / BLOCK_SIZE) {
+                dirty &= ~uint64_t(0) << (first % BLOCK_SIZE);
+            }
+            while (dirty != 0) {
+                const size_t index = block * BLOCK_SIZE + static_cast<size_t>(std::countr_zero(dirty));
+                if (!on_changed(index, _params[index])) {
+                    return index;
+                }
+                dirty &= dirty - 1;
+            }
+        }
+        return _params.size();
+    }
+
+private:
+    static constexpr uint16_t EMPTY_SLOT = UINT16_MAX;
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    void _mark_changed(const size_t index) {
+        _version++;
+        _versions[index] = _version;
+        _block_versions[index / BLOCK_SIZE] = _version;
+    }
+
+    // Bit i set if parameter block * 64 + i changed after since. No branch per parameter, so the compiler can vectorise it
+    uint64_t _changed_mask(const size_t block, const uint64_t since) const {
+        const size_t begin = block * BLOCK_SIZE;
+        const size_t end = begin + BLOCK_SIZE < _versions.size() ? begin + BLOCK_SIZE : _versions.size();
+        uint64_t mask = 0;
+        for (size_t i = begin; i < end; i++) {
+            mask |= static_cast<uint64_t>(_versions[i] > since) << (i - begin);
+        }
+        return mask;
+    }
+
+    // The slot holding id, or the empty slot where it would go
+    size_t _find_slot(const Mavlink_Param_Id &id) const {
+        size_t slot = static_cast<size_t>(id.hash()) & _mask;
+        while (_slots[slot] != EMPTY_SLOT && _params[_slots[slot]].id != id) {
+            slot = (slot + 1) & _mask;
+        }
+        return slot;
+    }
+
+    std::vector<Mavlink_Param> _params;
+    std::vector<uint16_t> _slots;
+    std::vector<uint64_t> _versions;
+    std::vector<uint64_t> _block_versions;
+    uint64_t _version = 0;
+    size_t _mask = 0;
+    size_t _capacity = 0;
+};
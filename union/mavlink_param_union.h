@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+// Taken from mavlink_types.h
+// Union helps a lot when you are trying to save memory in your application
+// In this example, you will see that all of the definitions scoped within the union
+// are placed at the same memory, hence accessible
+typedef struct param_union {
+	union {
+		float param_float;
+		int32_t param_int32;
+		uint32_t param_uint32;
+		int16_t param_int16;
+		uint16_t param_uint16;
+		int8_t param_int8;
+		uint8_t param_uint8;
+		uint8_t bytes[4];
+	};
+} mavlink_param_union_t;
+
+// The union alone does not say which member is the valid one, MAVLink sends this tag (param_type) along with every value.
+// Taken from the common dialect, the 64 bit types do not fit the union and are not used by parameters
+typedef enum MAV_PARAM_TYPE : uint8_t {
+	MAV_PARAM_TYPE_UINT8 = 1,
+	MAV_PARAM_TYPE_INT8 = 2,
+	MAV_PARAM_TYPE_UINT16 = 3,
+	MAV_PARAM_TYPE_INT16 = 4,
+	MAV_PARAM_TYPE_UINT32 = 5,
+	MAV_PARAM_TYPE_INT32 = 6,
+	MAV_PARAM_TYPE_UINT64 = 7,
+	MAV_PARAM_TYPE_INT64 = 8,
+	MAV_PARAM_TYPE_REAL32 = 9,
+	MAV_PARAM_TYPE_REAL64 = 10,
+} MAV_PARAM_TYPE;
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#include "mavlink_param_access.h"
+#include "mavlink_param_store.h"
+#include "mavlink_param_union.h"
+
+/*
+ * Wire codec for parameter values and PARAM_VALUE messages.
+ *
+ * MAVLink is little endian on the wire, whatever the host. The union alone has no byte order contract: bytes[4] is simply the memory
+ * of whatever member was written, so sending it as is only works by accident on little endian hosts. Everything here goes through
+ * Mavlink_Param_Value::raw() (the 4 wire bytes read as little endian) and the mavlink_store_le()/mavlink_load_le() helpers, which
+ * are a plain copy on little endian hosts and a single bswap on big endian ones. Which of the two is decided at compile time, so the
+ * encoders never branch on the byte order (or on anything else, apart from the bounds checks).
+ *
+ * A PARAM_VALUE (message id 22) payload is 25 bytes, the fields sorted by size like MAVLink does for every message:
+ *
+ *   | param_value (4) | param_count (2) | param_index (2) | param_id (16) | param_type (1) |
+ *
+ * and the MAVLink v2 frame around it adds 10 bytes of header and 2 of checksum, 37 bytes in total. param_type is never 0 for a valid
+ * parameter, so the v2 rule of stripping trailing zero bytes never shortens it and every frame has that same length. That is what lets
+ * mavlink_param_pack_batch() lay frames out back to back in one caller provided buffer, with one iovec per frame, ready to be handed
+ * to sendmmsg() (one datagram per frame, like autopilots send them):
+ *
+ *   buffer:  | frame 0 (37) | frame 1 (37) | frame 2 (37) | ...
+ *   iovecs:  {buffer, 37}    {buffer + 37, 37} ...
+ *
+ * Nothing is allocated, the codec only ever writes into memory it is given.
+ */
+
+constexpr uint8_t MAVLINK_PARAM_STX_V2 = 0xFD;
+constexpr uint32_t MAVLINK_MSG_ID_PARAM_VALUE = 22;
+constexpr uint8_t MAVLINK_MSG_PARAM_VALUE_CRC_EXTRA = 220;
+constexpr size_t MAVLINK_MSG_PARAM_VALUE_LEN = 25;
+constexpr size_t MAVLINK_PARAM_HEADER_LEN = 10;
+constexpr size_t MAVLINK_PARAM_CHECKSUM_LEN = 2;
+constexpr size_t MAVLINK_PARAM_VALUE_FRAME_LEN = MAVLINK_PARAM_HEADER_LEN + MAVLINK_MSG_PARAM_VALUE_LEN + MAVLINK_PARAM_CHECKSUM_LEN;
+
+// Byte order helpers. The swap is resolved at compile time, on little endian hosts both are a memcpy the compiler turns into a move
+template <typename T>
+constexpr T mavlink_byteswap(const T value) {
+    if constexpr (sizeof(T) == 2) {
+        return static_cast<T>(__builtin_bswap16(static_cast<uint16_t>(value)));
+    } else if constexpr (sizeof(T) == 4) {
+        return static_cast<T>(__builtin_bswap32(static_cast<uint32_t>(value)));
+    } else {
+        return value;
+    }
+}
+
+template <typename T>
+inline void mavlink_store_le(uint8_t *out, T value) {
+    if constexpr (std::endian::native == std::endian::big) {
+        value = mavlink_byteswap(value);
+    }
+    std::memcpy(out, &value, sizeof(value));
+}
+
+template <typename T>
+inline T mavlink_load_le(const uint8_t *in) {
+    T value;
+    std::memcpy(&value, in, sizeof(value));
+    if constexpr (std::endian::native == std::endian::big) {
+        value = mavlink_byteswap(value);
+    }
+    return value;
+}
+
+// The 4 wire bytes of a value
+inline void mavlink_param_value_write(uint8_t *out, const mavlink_param_union_t value) {
+    mavlink_store_le(out, Mavlink_Param_Value::from_union(value).raw());
+}
+
+inline mavlink_param_union_t mavlink_param_value_read(const uint8_t *in) {
+    return Mavlink_Param_Value::from_bytes_le({in[0], in[1], in[2], in[3]}).to_union();
+}
+
+// count values back to back, 4 bytes each. On little endian hosts that is the memory of the array already, and a single copy
+inline void mavlink_param_values_write(const mavlink_param_union_t *values, const size_t count, uint8_t *out) {
+    if constexpr (std::endian::native == std::endian::little) {
+        std::memcpy(out, values, count * sizeof(mavlink_param_union_t));
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            mavlink_param_value_write(out + i * sizeof(mavlink_param_union_t), values[i]);
+        }
+    }
+}
+
+// CRC-16/MCRF4XX like every MAVLink frame, with the table generated at compile time
+constexpr std::array<uint16_t, 256> mavlink_param_make_crc_table() {
+    std::array<uint16_t, 256> table {};
+    for (uint16_t byte = 0; byte < 256; byte++) {
+        uint16_t crc = byte;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? static_cast<uint16_t>((crc >> 1) ^ 0x8408) : static_cast<uint16_t>(crc >> 1);
+        }
+        table[byte] = crc;
+    }
+    return table;
+}
+
+inline constexpr std::array<uint16_t, 256> MAVLINK_PARAM_CRC_TABLE = mavlink_param_make_crc_table();
+
+inline uint16_t mavlink_param_crc(const uint8_t *data, const size_t length, const uint8_t extra) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc = static_cast<uint16_t>((crc >> 8) ^ MAVLINK_PARAM_CRC_TABLE[(crc ^ data[i]) & 0xFF]);
+    }
+    return static_cast<uint16_t>((crc >> 8) ^ MAVLINK_PARAM_CRC_TABLE[(crc ^ extra) & 0xFF]);
+}
+
+// Where a PARAM_VALUE comes from
+struct Mavlink_Param_Sender_Id {
+    uint8_t sysid;
+    uint8_t compid;
+};
+
+// A PARAM_VALUE as received
+struct Mavlink_Param_Value_Message {
+    Mavlink_Param param;
+    uint16_t index;
+    uint16_t count;
+};
+
+// The 25 byte payload
+inline void mavlink_param_value_pack_payload(uint8_t *out, const Mavlink_Param &param, const uint16_t index, const uint16_t count) {
+    mavlink_param_value_write(out, param.value);
+    mavlink_store_le(out + 4, count);
+    mavlink_store_le(out + 6, index);
+    std::memcpy(out + 8, param.id.chars, MAVLINK_PARAM_ID_LEN);
+    out[24] = param.type;
+}
+
+// Serializes a whole v2 frame into out, which has to hold MAVLINK_PARAM_VALUE_FRAME_LEN bytes. Returns the number of bytes written
+inline size_t mavlink_param_value_pack(uint8_t *out, const uint8_t seq, const Mavlink_Param_Sender_Id sender, const Mavlink_Param &param,
+                                       const uint16_t index, const uint16_t count) {
+    out[0] = MAVLINK_PARAM_STX_V2;
+    out[1] = static_cast<uint8_t>(MAVLINK_MSG_PARAM_VALUE_LEN);
+    out[2] = 0;
+    out[3] = 0;
+    out[4] = seq;
+    out[5] = sender.sysid;
+    out[6] = sender.compid;
+    out[7] = static_cast<uint8_t>(MAVLINK_MSG_ID_PARAM_VALUE);
+    out[8] = 0;
+    out[9] = 0;
+    mavlink_param_value_pack_payload(out + MAVLINK_PARAM_HEADER_LEN, param, index, count);
+
+    const size_t crc_end = MAVLINK_PARAM_HEADER_LEN + MAVLINK_MSG_PARAM_VALUE_LEN;
+    mavlink_store_le(out + crc_end, mavlink_param_crc(out + 1, crc_end - 1, MAVLINK_MSG_PARAM_VALUE_CRC_EXTRA));
+    return MAVLINK_PARAM_VALUE_FRAME_LEN;
+}
+
+// Checks and decodes a v2 PARAM_VALUE frame (unsigned, possibly with its trailing zeros stripped by another sender). Returns false
+// if it is not one or the checksum does not match
+inline bool mavlink_param_value_unpack(std::span<const uint8_t> frame, Mavlink_Param_Value_Message &message) {
+
+    if (frame.size() < MAVLINK_PARAM_HEADER_LEN + MAVLINK_PARAM_CHECKSUM_LEN || frame[0] != MAVLINK_PARAM_STX_V2) {
+        return false;
+    }
+    const size_t length = frame[1];
+    if (length > MAVLINK_MSG_PARAM_VALUE_LEN || frame.size() < MAVLINK_PARAM_HEADER_LEN + length + MAVLINK_PARAM_CHECKSUM_LEN ||
+        (frame[7] | frame[8] << 8 | frame[9] << 16) != static_cast<int>(MAVLINK_MSG_ID_PARAM_VALUE)) {
+        return false;
+    }
+    const size_t crc_end = MAVLINK_PARAM_HEADER_LEN + length;
+    if (mavlink_load_le<uint16_t>(frame.data() + crc_end) !=
+        mavlink_param_crc(frame.data() + 1, crc_end - 1, MAVLINK_MSG_PARAM_VALUE_CRC_EXTRA)) {
+        return false;
+    }
+
+    // Put the stripped zeros back
+    uint8_t payload[MAVLINK_MSG_PARAM_VALUE_LEN] = {};
+    std::memcpy(payload, frame.data() + MAVLINK_PARAM_HEADER_LEN, length);
+
+    message.param.value = mavlink_param_value_read(payload);
+    message.count = mavlink_load_le<uint16_t>(payload + 4);
+    message.index = mavlink_load_le<uint16_t>(payload + 6);
+    message.param.id = Mavlink_Param_Id::from_wire(reinterpret_cast<const char *>(payload + 8));
+    message.param.type = static_cast<MAV_PARAM_TYPE>(payload[24]);
+    return true;
+}
+
+// Packs the PARAM_VALUE of the parameters first, first + 1, ... of store, as many as fit both buffer and frames (and the table),
+// back to back into buffer, and points one iovec per frame at it. seq is the sequence number of the first frame and is advanced by
+// one per frame. Returns the number of frames, the caller sends them with sendmmsg() or one writev() per iovec.
+inline size_t mavlink_param_pack_batch(const Mavlink_Param_Store &store, const size_t first, std::span<uint8_t> buffer,
+                                       std::span<iovec> frames, uint8_t &seq, const Mavlink_Param_Sender_Id sender) {
+
+    size_t count = buffer.size() / MAVLINK_PARAM_VALUE_FRAME_LEN;
+    if (count > frames.size()) {
+        count = frames.size();
+    }
+    if (first >= store.size()) {
+        return 0;
+    }
+    if (count > store.size() - first) {
+        count = store.size() - first;
+    }
+
+    const uint16_t param_count = static_cast<uint16_t>(store.size());
+    uint8_t *out = buffer.data();
+    for (size_t i = 0; i < count; i++) {
+        const uint16_t index = static_cast<uint16_t>(first + i);
+        mavlink_param_value_pack(out, seq++, sender, store.get(index), index, param_count);
+        frames[i].iov_base = out;
+        frames[i].iov_len = MAVLINK_PARAM_VALUE_FRAME_LEN;
+        out += MAVLINK_PARAM_VALUE_FRAME_LEN;
+    }
+    return count;
+}
+
+// Like mavlink_param_pack_batch(), but only for the parameters changed after version since (see Mavlink_Param_Store::version()).
+// Starts at index next and leaves it where the next batch has to start, store.size() once the delta is complete. A broadcast round
+// therefore takes store.version() first, sends batches until next reaches store.size(), and uses that version as since next round.
+// buffer and frames have to have room for at least one frame, otherwise nothing is packed and next does not move
+inline size_t mavlink_param_pack_changed(const Mavlink_Param_Store &store, const uint64_t since, size_t &next, std::span<uint8_t> buffer,
+                                         std::span<iovec> frames, uint8_t &seq, const Mavlink_Param_Sender_Id sender) {
+
+    size_t count = buffer.size() / MAVLINK_PARAM_VALUE_FRAME_LEN;
+    if (count > frames.size()) {
+        count = frames.size();
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    const uint16_t param_count = static_cast<uint16_t>(store.size());
+    size_t packed = 0;
+    next = store.for_each_changed(since, [&](const size_t index, const Mavlink_Param &param) {
+        if (packed == count) {
+            return false;
+        }
+        uint8_t *out = buffer.data() + packed * MAVLINK_PARAM_VALUE_FRAME_LEN;
+        mavlink_param_value_pack(out, seq++, sender, param, static_cast<uint16_t>(index), param_count);
+        frames[packed].iov_base = out;
+        frames[packed].iov_len = MAVLINK_PARAM_VALUE_FRAME_LEN;
+        packed++;
+        return true;
+    }, next);
+    return packed;
+}
+
+static_assert(sizeof(Mavlink_Param_Id) == 16 && MAVLINK_PARAM_VALUE_FRAME_LEN == 37, "PARAM_VALUE layout");
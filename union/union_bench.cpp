@@ -0,0 +1,301 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "mavlink_param_access.h"
+#include "mavlink_param_convert.h"
+#include "mavlink_param_wire.h"
+
+/*
+ * Benchmark of the parameter value layer.
+ *
+ * benchmark "accessor": the same loops over an array of mavlink_param_union_t, once with raw member access and once through
+ * mavlink_param_get<T>()/mavlink_param_set<T>() (see mavlink_param_access.h). The accessors copy the 4 bytes out and std::bit_cast
+ * them, and this shows that the compiler sees through all of it: both columns should be within noise of each other.
+ *
+ * benchmark "bulk_convert": mavlink_param_decode()/mavlink_param_encode() over a parameter dump with randomly mixed types, scalar
+ * against AVX2 (see mavlink_param_convert.h), when the CPU has it. The two are compared value by value first, and if they differ the
+ * benchmark stops there and exits with 1.
+ *
+ * benchmark "wire": packing the whole table as PARAM_VALUE frames in sendmmsg() sized batches, and checking and decoding them again
+ * (see mavlink_param_wire.h). The values are frames here, the socket is left out so only the codec is measured. "broadcast" is one
+ * periodic broadcast round with 1% of the table changed, all of it against only the delta (see Mavlink_Param_Store::version()); its
+ * values are the parameters in the table.
+ *
+ * The output is one JSON object per line, like daq_bench:
+ *   union_bench [seconds per measurement, default 0.5]
+ */
+
+static constexpr size_t VALUE_COUNT = 4096;
+
+// Repeats pass() until seconds have elapsed, returns the nanoseconds per value
+template <typename Pass>
+static double measure(Pass pass, const double seconds) {
+
+    uint64_t passes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::duration<double>(seconds);
+    auto now = start;
+
+    while (now < end) {
+        for (size_t i = 0; i < 16; i++) {
+            pass();
+        }
+        passes += 16;
+        now = std::chrono::steady_clock::now();
+    }
+
+    const double elapsed = std::chrono::duration<double>(now - start).count();
+    return elapsed * 1e9 / static_cast<double>(passes * VALUE_COUNT);
+}
+
+static void print_result(const char *benchmark, const char *operation, const char *mode, const double ns_per_value) {
+    std::printf("{\"benchmark\":\"%s\",\"operation\":\"%s\",\"mode\":\"%s\",\"values\":%zu,\"ns_per_value\":%.3f}\n",
+                benchmark, operation, mode, VALUE_COUNT, ns_per_value);
+    std::fflush(stdout);
+}
+
+static void run_accessor(const double seconds) {
+
+    std::vector<mavlink_param_union_t> values(VALUE_COUNT);
+    // Keeps the compiler from dropping the loops
+    volatile float float_sink = 0.0f;
+    volatile int32_t int_sink = 0;
+
+    // Every member read below is the one written last, so the raw loops are well defined too
+    for (size_t i = 0; i < VALUE_COUNT; i++) {
+        values[i].param_float = static_cast<float>(i) * 0.5f;
+    }
+    print_result("accessor", "read_float", "raw", measure([&] {
+        float sum = 0.0f;
+        for (const mavlink_param_union_t &value : values) {
+            sum += value.param_float;
+        }
+        float_sink = sum;
+    }, seconds));
+    print_result("accessor", "read_float", "bit_cast", measure([&] {
+        float sum = 0.0f;
+        for (const mavlink_param_union_t &value : values) {
+            sum += mavlink_param_get<float>(value);
+        }
+        float_sink = sum;
+    }, seconds));
+
+    // Counted unsigned, a long run writes billions of values and wraps around. Converting to int32_t is modular since C++20
+    uint32_t next = 0;
+    print_result("accessor", "write_int32", "raw", measure([&] {
+        for (mavlink_param_union_t &value : values) {
+            value.param_int32 = static_cast<int32_t>(next++);
+        }
+    }, seconds));
+    print_result("accessor", "write_int32", "bit_cast", measure([&] {
+        for (mavlink_param_union_t &value : values) {
+            mavlink_param_set<int32_t>(value, static_cast<int32_t>(next++));
+        }
+    }, seconds));
+
+    print_result("accessor", "read_int32", "raw", measure([&] {
+        // Summed unsigned as well, the values written above add up far past INT32_MAX
+        uint32_t sum = 0;
+        for (const mavlink_param_union_t &value : values) {
+            sum += static_cast<uint32_t>(value.param_int32);
+        }
+        int_sink = static_cast<int32_t>(sum);
+    }, seconds));
+    print_result("accessor", "read_int32", "bit_cast", measure([&] {
+        uint32_t sum = 0;
+        for (const mavlink_param_union_t &value : values) {
+            sum += static_cast<uint32_t>(mavlink_param_get<int32_t>(value));
+        }
+        int_sink = static_cast<int32_t>(sum);
+    }, seconds));
+}
+
+#ifdef MAVLINK_PARAM_CONVERT_X86
+// Decodes and encodes values with both the scalar and the AVX2 conversions and compares the results bit for bit (any NaN matches
+// any other, the payload is not part of the contract). Returns false and tells which value differs at the first mismatch
+static bool check_avx2_matches_scalar(const std::vector<mavlink_param_union_t> &values, const std::vector<uint8_t> &types,
+                                      const std::vector<double> &doubles) {
+
+    const size_t count = values.size();
+    std::vector<double> scalar_decoded(count);
+    std::vector<double> avx2_decoded(count);
+    mavlink_param_decode_scalar(values.data(), types.data(), count, scalar_decoded.data());
+    mavlink_param_decode_avx2(values.data(), types.data(), count, avx2_decoded.data());
+    for (size_t i = 0; i < count; i++) {
+        const bool both_nan = scalar_decoded[i] != scalar_decoded[i] && avx2_decoded[i] != avx2_decoded[i];
+        if (!both_nan && std::memcmp(&scalar_decoded[i], &avx2_decoded[i], sizeof(double)) != 0) {
+            std::fprintf(stderr, "decode mismatch at %zu: type %u raw 0x%08x scalar %.17g avx2 %.17g\n", i, types[i],
+                         Mavlink_Param_Value::from_union(values[i]).raw(), scalar_decoded[i], avx2_decoded[i]);
+            return false;
+        }
+    }
+
+    std::vector<mavlink_param_union_t> scalar_encoded(count);
+    std::vector<mavlink_param_union_t> avx2_encoded(count);
+    mavlink_param_encode_scalar(doubles.data(), types.data(), count, scalar_encoded.data());
+    mavlink_param_encode_avx2(doubles.data(), types.data(), count, avx2_encoded.data());
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t scalar = Mavlink_Param_Value::from_union(scalar_encoded[i]).raw();
+        const uint32_t avx2 = Mavlink_Param_Value::from_union(avx2_encoded[i]).raw();
+        const bool both_nan = types[i] == MAV_PARAM_TYPE_REAL32 && std::isnan(mavlink_param_get<float>(scalar_encoded[i])) &&
+                              std::isnan(mavlink_param_get<float>(avx2_encoded[i]));
+        if (!both_nan && scalar != avx2) {
+            std::fprintf(stderr, "encode mismatch at %zu: type %u value %.17g scalar 0x%08x avx2 0x%08x\n", i, types[i], doubles[i],
+                         scalar, avx2);
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+// Returns false if the AVX2 conversions do not give the same results as the scalar ones, nothing is measured then
+static bool run_bulk_convert(const double seconds) {
+
+    std::mt19937 random(1);
+    std::vector<mavlink_param_union_t> values(VALUE_COUNT);
+    std::vector<uint8_t> types(VALUE_COUNT);
+    std::vector<double> decoded(VALUE_COUNT);
+    std::vector<mavlink_param_union_t> encoded(VALUE_COUNT);
+
+    const uint8_t type_choices[] = {MAV_PARAM_TYPE_UINT8, MAV_PARAM_TYPE_INT8, MAV_PARAM_TYPE_UINT16, MAV_PARAM_TYPE_INT16,
+                                    MAV_PARAM_TYPE_UINT32, MAV_PARAM_TYPE_INT32, MAV_PARAM_TYPE_REAL32};
+    for (size_t i = 0; i < VALUE_COUNT; i++) {
+        types[i] = type_choices[random() % std::size(type_choices)];
+        values[i] = Mavlink_Param_Value::of<uint32_t>(static_cast<uint32_t>(random())).to_union();
+    }
+    mavlink_param_decode_scalar(values.data(), types.data(), VALUE_COUNT, decoded.data());
+    for (double &value : decoded) {
+        // Encoding a NaN is a shortcut for the integer types, keep the measurement on real values
+        if (value != value) {
+            value = 0.0;
+        }
+    }
+
+#ifdef MAVLINK_PARAM_CONVERT_X86
+    if (__builtin_cpu_supports("avx2")) {
+        // Every type tag, including invalid ones, and values around the edges of the encoding: ties, the limits of every type, just
+        // past them, infinities and NaN. The count is not a multiple of 8, so the tail after the last full vector is covered as well
+        const double edges[] = {0.5, 1.5, 2.5, -0.5, -1.5, -2.5, 127.5, 128.0, -128.5, -129.0, 255.5, 256.0, 32767.5, -32768.5, 65535.5,
+                                65536.0, 2147483647.5, -2147483648.5, 4294967295.5, 4294967296.0, -1e300, 1e300, 3.4e38, 3.5e38,
+                                1e-320, -0.0, std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+                                std::numeric_limits<double>::quiet_NaN()};
+        const size_t check_count = VALUE_COUNT + 5;
+        std::vector<mavlink_param_union_t> check_values(check_count);
+        std::vector<uint8_t> check_types(check_count);
+        std::vector<double> check_doubles(check_count);
+        std::uniform_real_distribution<double> wide(-5e9, 5e9);
+        for (size_t i = 0; i < check_count; i++) {
+            check_types[i] = static_cast<uint8_t>(random() % 20);
+            check_values[i] = Mavlink_Param_Value::of<uint32_t>(static_cast<uint32_t>(random())).to_union();
+            check_doubles[i] = i % 2 == 0 ? edges[random() % std::size(edges)] : wide(random);
+        }
+        if (!check_avx2_matches_scalar(check_values, check_types, check_doubles) ||
+            !check_avx2_matches_scalar(values, types, decoded)) {
+            return false;
+        }
+    }
+#endif
+
+    print_result("bulk_convert", "decode", "scalar", measure([&] {
+        mavlink_param_decode_scalar(values.data(), types.data(), VALUE_COUNT, decoded.data());
+    }, seconds));
+    print_result("bulk_convert", "encode", "scalar", measure([&] {
+        mavlink_param_encode_scalar(decoded.data(), types.data(), VALUE_COUNT, encoded.data());
+    }, seconds));
+
+#ifdef MAVLINK_PARAM_CONVERT_X86
+    if (__builtin_cpu_supports("avx2")) {
+        print_result("bulk_convert", "decode", "avx2", measure([&] {
+            mavlink_param_decode_avx2(values.data(), types.data(), VALUE_COUNT, decoded.data());
+        }, seconds));
+        print_result("bulk_convert", "encode", "avx2", measure([&] {
+            mavlink_param_encode_avx2(decoded.data(), types.data(), VALUE_COUNT, encoded.data());
+        }, seconds));
+    }
+#endif
+    return true;
+}
+
+static void run_wire(const double seconds) {
+
+    // As many frames as one sendmmsg() call takes (UIO_MAXIOV)
+    constexpr size_t BATCH_FRAMES = 1024;
+
+    Mavlink_Param_Store store(VALUE_COUNT);
+    for (size_t i = 0; i < VALUE_COUNT; i++) {
+        const std::string id = "BENCH_PARAM_" + std::to_string(i);
+        store.add(std::string_view(id), MAV_PARAM_TYPE_REAL32, Mavlink_Param_Value::of(static_cast<float>(i)).to_union());
+    }
+    std::vector<uint8_t> buffer(VALUE_COUNT * MAVLINK_PARAM_VALUE_FRAME_LEN);
+    std::vector<iovec> frames(VALUE_COUNT);
+    uint8_t seq = 0;
+
+    print_result("wire", "pack_param_value", "batch", measure([&] {
+        size_t first = 0;
+        while (first < store.size()) {
+            const size_t offset = first * MAVLINK_PARAM_VALUE_FRAME_LEN;
+            first += mavlink_param_pack_batch(store, first, {buffer.data() + offset, BATCH_FRAMES * MAVLINK_PARAM_VALUE_FRAME_LEN},
+                                              {frames.data() + first, BATCH_FRAMES}, seq, {1, 1});
+        }
+    }, seconds));
+
+    // Keeps the compiler from dropping the loops
+    volatile uint32_t sink = 0;
+    print_result("wire", "unpack_param_value", "batch", measure([&] {
+        Mavlink_Param_Value_Message message;
+        uint32_t indices = 0;
+        for (const iovec &frame : frames) {
+            if (mavlink_param_value_unpack({static_cast<const uint8_t *>(frame.iov_base), frame.iov_len}, message)) {
+                indices += message.index;
+            }
+        }
+        sink = indices;
+    }, seconds));
+
+    const uint64_t since = store.version();
+    for (size_t i = 0; i < VALUE_COUNT; i += 100) {
+        store.set(store.get(i).id, MAV_PARAM_TYPE_REAL32, Mavlink_Param_Value::of(-1.0f).to_union());
+    }
+    print_result("wire", "broadcast", "full", measure([&] {
+        size_t first = 0;
+        while (size_t packed = mavlink_param_pack_batch(store, first, buffer, frames, seq, {1, 1})) {
+            first += packed;
+        }
+        sink = static_cast<uint32_t>(first);
+    }, seconds));
+    print_result("wire", "broadcast", "delta", measure([&] {
+        size_t next = 0;
+        size_t sent = 0;
+        while (next < store.size()) {
+            const size_t packed = mavlink_param_pack_changed(store, since, next, buffer, frames, seq, {1, 1});
+            // Only with a buffer too small for a single frame, which would never get anywhere
+            if (packed == 0) {
+                break;
+            }
+            sent += packed;
+        }
+        sink = static_cast<uint32_t>(sent);
+    }, seconds));
+}
+
+int main(int argc, char **argv) {
+
+    const double seconds = argc > 1 ? std::atof(argv[1]) : 0.5;
+
+    run_accessor(seconds);
+    if (!run_bulk_convert(seconds)) {
+        std::fprintf(stderr, "union_bench: the AVX2 conversions do not match the scalar ones\n");
+        return 1;
+    }
+    run_wire(seconds);
+
+    return 0;
+}
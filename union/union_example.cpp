@@ -1,3 +1,4 @@
+#include <array>
 #include <cstdint>
 #include <typeinfo>
 #include <spdlog/spdlog.h>
@@ -45,69 +46,111 @@
  *   Output: std::__cxx11::basic_string<char, std::char_traits<char>, std::allocator<char> >
  */
 
-// Taken from mavlink_types.h 
-// Union helps a lot when you are trying to save memory in your application
-// In this example, you will see that all of the definitions scoped within the union
-// are placed at the same memory, hence accessible
-typedef struct param_union {
-	union {
-		float param_float;
-		int32_t param_int32;
-		uint32_t param_uint32;
-		int16_t param_int16;
-		uint16_t param_uint16;
-		int8_t param_int8;
-		uint8_t param_uint8;
-		uint8_t bytes[4];
-	};
-} mavlink_param_union_t;
+// mavlink_param_union_t (taken from mavlink_types.h) now lives in its own header, so the parameter table can use it as well
+#include "mavlink_param_union.h"
+#include "mavlink_param_access.h"
+#include "mavlink_param_convert.h"
+#include "mavlink_param_store.h"
+#include "mavlink_param_wire.h"
+
+// Reading a member other than the one written last (type punning) is undefined behaviour in C++, so the union is always read
+// through the accessors of mavlink_param_access.h, which copy the bits with std::bit_cast instead
+static void print_union(const mavlink_param_union_t &mav_type) {
+    const std::array<uint8_t, 4> bytes = Mavlink_Param_Value::from_union(mav_type).bytes_le();
+    // Cast it as a generic pointer representation to be able to print the address
+    spdlog::info("Union address: {}", (const void *)&mav_type);
+    spdlog::info("Size: {} bytes", sizeof(mav_type));
+    spdlog::info("Bytes in memory order: {:02x} {:02x} {:02x} {:02x}", bytes[0], bytes[1], bytes[2], bytes[3]);
+    spdlog::info("Current value as float: {}", mavlink_param_get<float>(mav_type));
+    spdlog::info("Current value as uint8_t: {}", mavlink_param_get<uint8_t>(mav_type));
+    spdlog::info("Current value as uint16_t: {}", mavlink_param_get<uint16_t>(mav_type));
+    spdlog::info("Current value as int16_t: {}", mavlink_param_get<int16_t>(mav_type));
+}
 
 int main() {
-    
+
     // All int type (both unsigned and signed) will output the correct value
+    // set<T>() zeroes the bytes T does not cover, so unlike assigning param_uint8 there is no leftover garbage in the upper bytes
     uint8_t tmp = 1;
     mavlink_param_union_t mav_type;
-    mav_type.param_uint8 = tmp;
-    // Cast it as a generic pointer representation to be able to print the address
-    spdlog::info("Union address: {}", (void *)&mav_type);
-    spdlog::info("Size: {} bytes", sizeof(mav_type));
-    spdlog::info("Current value as float: {}", mav_type.param_float);
-    spdlog::info("Current value as uint8_t: {}", mav_type.param_uint8);
-    spdlog::info("Current value as uint16_t: {}", mav_type.param_uint16);
-    spdlog::info("Current value as int16_t: {}", mav_type.param_int16);
+    mavlink_param_set<uint8_t>(mav_type, tmp);
+    print_union(mav_type);
 
     // Both uint8 and int16 will overflow, giving garbage values
     // float will be wrong in this case
     uint16_t tmp_uint16 = 40000;
-    mav_type.param_uint16 = tmp_uint16;
-    // Cast it as a generic pointer representation to be able to print the address
-    spdlog::info("Union address: {}", (void *)&mav_type);
-    spdlog::info("Size: {} bytes", sizeof(mav_type));
-    spdlog::info("Current value as float: {}", mav_type.param_float);
-    spdlog::info("Current value as uint8_t: {}", mav_type.param_uint8);
-    spdlog::info("Current value as uint16_t: {}", mav_type.param_uint16);
-    spdlog::info("Current value as int16_t: {}", mav_type.param_int16);
+    mavlink_param_set<uint16_t>(mav_type, tmp_uint16);
+    print_union(mav_type);
 
     float tmp_float = 2.0f;
-    mav_type.param_float = tmp_float;
-    spdlog::info("Union address: {}", (void *)&mav_type);
-    spdlog::info("Size: {} bytes", sizeof(mav_type));
-    spdlog::info("Current value as float: {}", mav_type.param_float);
-    spdlog::info("Current value as uint8_t: {}", mav_type.param_uint8);
-    spdlog::info("Current value as uint16_t: {}", mav_type.param_uint16);
-    spdlog::info("Current value as int16_t: {}", mav_type.param_int16);
+    mavlink_param_set<float>(mav_type, tmp_float);
+    print_union(mav_type);
 
     // float will return something wrong because the float bit decoding will be different
     // uint8 and uint16 will overflow
     // int16 will output the correct value
     int16_t tmp_int16 = -1;
-    mav_type.param_int16 = tmp_int16;
-    spdlog::info("Union address: {}", (void *)&mav_type);
-    spdlog::info("Size: {} bytes", sizeof(mav_type));
-    spdlog::info("Current value as float: {}", mav_type.param_float);
-    spdlog::info("Current value as uint8_t: {}", mav_type.param_uint8);
-    spdlog::info("Current value as uint16_t: {}", mav_type.param_uint16);
-    spdlog::info("Current value as int16_t: {}", mav_type.param_int16);
+    mavlink_param_set<int16_t>(mav_type, tmp_int16);
+    print_union(mav_type);
+
+    // The same accessors work at compile time on Mavlink_Param_Value, which only holds the 4 bytes
+    constexpr Mavlink_Param_Value compile_time = Mavlink_Param_Value::of<int16_t>(-1);
+    static_assert(compile_time.get<uint16_t>() == 65535);
+    // And they can check the MAVLink type tag that comes with a value
+    spdlog::info("-1 read back as INT16: {}, as REAL32: {}", compile_time.get_if<int16_t>(MAV_PARAM_TYPE_INT16).value_or(0),
+                 compile_time.get_if<float>(MAV_PARAM_TYPE_INT16).has_value() ? "valid" : "type mismatch");
+
+    // The union is what a parameter table stores, with a tag telling which member is valid (see mavlink_param_store.h)
+    Mavlink_Param_Store params(1024);
+    params.add("ATC_RAT_RLL_P", MAV_PARAM_TYPE_REAL32, Mavlink_Param_Value::of(0.135f).to_union());
+    params.add("SYSID_THISMAV", MAV_PARAM_TYPE_INT32, Mavlink_Param_Value::of<int32_t>(0).to_union());
+    params.add("ARMING_CHECK", MAV_PARAM_TYPE_UINT8, Mavlink_Param_Value::of<uint8_t>(1).to_union());
+
+    // PARAM_SET for an existing parameter, then once with the wrong type (TYPE_MISMATCH) and once for an unknown id (NOT_FOUND)
+    const mavlink_param_union_t value = Mavlink_Param_Value::of<int32_t>(42).to_union();
+    spdlog::info("PARAM_SET SYSID_THISMAV as INT32: {}", params.set("SYSID_THISMAV", MAV_PARAM_TYPE_INT32, value));
+    spdlog::info("PARAM_SET SYSID_THISMAV as REAL32: {}", params.set("SYSID_THISMAV", MAV_PARAM_TYPE_REAL32, value));
+    spdlog::info("PARAM_SET SYSID_THISMAX as INT32: {}", params.set("SYSID_THISMAX", MAV_PARAM_TYPE_INT32, value));
+
+    // PARAM_REQUEST_LIST walks the stable indices
+    for (size_t i = 0; i < params.size(); i++) {
+        const Mavlink_Param &param = params.get(i);
+        const std::array<uint8_t, 4> bytes = Mavlink_Param_Value::from_union(param.value).bytes_le();
+        spdlog::info("Param {}/{}: {} type {} bytes {:02x} {:02x} {:02x} {:02x}", i, params.size(), param.id.view(),
+                     static_cast<int>(param.type), bytes[0], bytes[1], bytes[2], bytes[3]);
+    }
+
+    // A full parameter dump is decoded in bulk, the type of every value picks the union member without a branch per value
+    mavlink_param_union_t dump_values[3];
+    uint8_t dump_types[3];
+    double decoded[3];
+    for (size_t i = 0; i < params.size(); i++) {
+        dump_values[i] = params.get(i).value;
+        dump_types[i] = params.get(i).type;
+    }
+    mavlink_param_decode(dump_values, dump_types, params.size(), decoded);
+    spdlog::info("Decoded dump: {} {} {}", decoded[0], decoded[1], decoded[2]);
+
+    // The same list as it goes on the wire: one PARAM_VALUE frame per parameter, back to back in one buffer, with an iovec per frame
+    // for sendmmsg(). Decoding the first frame again gives back the parameter, whatever the byte order of the host
+    std::array<uint8_t, 3 * MAVLINK_PARAM_VALUE_FRAME_LEN> wire;
+    std::array<iovec, 3> frames;
+    uint8_t seq = 0;
+    const size_t packed = mavlink_param_pack_batch(params, 0, wire, frames, seq, {1, 1});
+    Mavlink_Param_Value_Message message;
+    if (packed > 0 && mavlink_param_value_unpack({wire.data(), frames[0].iov_len}, message)) {
+        spdlog::info("Packed {} PARAM_VALUE frames of {} bytes, first one: {} {}/{} = {}", packed, frames[0].iov_len,
+                     message.param.id.view(), message.index, message.count, mavlink_param_get<float>(message.param.value));
+    }
+
+    // The next broadcast only sends what changed since the version the last one went out at
+    const uint64_t broadcast_version = params.version();
+    params.set("ARMING_CHECK", MAV_PARAM_TYPE_UINT8, Mavlink_Param_Value::of<uint8_t>(0).to_union());
+    params.set("SYSID_THISMAV", MAV_PARAM_TYPE_INT32, Mavlink_Param_Value::of<int32_t>(42).to_union());
+    params.for_each_changed(broadcast_version, [](const size_t index, const Mavlink_Param &param) {
+        spdlog::info("Changed since the last broadcast: {} (index {})", param.id.view(), index);
+        return true;
+    });
 
     return 0;
 }
\ No newline at end of file